@@ -40,4 +40,25 @@ UInt32 BacklightHandler2::getBacklightLevel()
 void BacklightHandler2::initBacklight(BacklightConfig* config)
 {
     // no implementation
-}
\ No newline at end of file
+}
+
+void BacklightHandler2::resyncBacklight()
+{
+    // no implementation
+}
+
+UInt32 BacklightHandler2::getHardwarePWMMax()
+{
+    // no implementation
+    return 0;
+}
+
+void BacklightHandler2::addStats(OSDictionary* dict)
+{
+    // no implementation
+}
+
+void BacklightHandler2::resetStats()
+{
+    // no implementation
+}
@@ -25,19 +25,7 @@
 
 #include <IOKit/IOService.h>
 #include "Common.h"
-
-struct BacklightConfig
-{
-    UInt16 m_pwmMax;
-    UInt32 m_pchlInit;
-    UInt32 m_levwInit;
-    UInt32 m_options;
-    UInt16 m_backlightMin;
-    UInt16 m_backlightMax;
-    UInt16 m_backlightLevelsScale;
-    UInt16 m_nLevels;
-    UInt16* m_backlightLevels;
-};
+#include "Configuration.h"
 
 class EXPORT BacklightHandler2 : public IOService
 {
@@ -52,6 +40,10 @@ public:
     virtual void initBacklight(BacklightConfig* config);
     virtual void setBacklightLevel(UInt32 level);
     virtual UInt32 getBacklightLevel();
+    virtual void resyncBacklight();
+    virtual UInt32 getHardwarePWMMax();
+    virtual void addStats(OSDictionary* dict);
+    virtual void resetStats();
 };
 
 #endif // _BACKLIGHT_HANDLER_H
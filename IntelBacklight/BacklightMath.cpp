@@ -0,0 +1,218 @@
+//
+//  BacklightMath.cpp
+//
+
+#include "BacklightMath.h"
+
+#define countof(x) (sizeof((x))/sizeof((x)[0]))
+
+// 2^(1/2), 2^(1/4), ... 2^(1/65536) in 2.30 fixed point
+static const UInt32 fixedExp2Table[] =
+{
+    0x5A82799A, 0x4C1BF829, 0x45CAE0F2, 0x42D561B4, 0x4166C34C, 0x40B268FA, 0x4058F6A8, 0x402C6BE9,
+    0x4016321B, 0x400B1818, 0x40058BCE, 0x4002C5D8, 0x400162E8, 0x4000B173, 0x400058B9, 0x40002C5D,
+};
+
+SInt32 fixedLog2(UInt32 x)
+{
+    // x must be non-zero
+    SInt32 result = 0;
+    // normalize to [1,2)
+    while (x >= 2*kFixedOne)
+    {
+        x >>= 1;
+        result += kFixedOne;
+    }
+    while (x < kFixedOne)
+    {
+        x <<= 1;
+        result -= kFixedOne;
+    }
+    // fractional bits by repeated squaring
+    for (SInt32 bit = kFixedOne>>1; bit; bit >>= 1)
+    {
+        x = (UInt32)(((UInt64)x * x) >> 16);
+        if (x >= 2*kFixedOne)
+        {
+            x >>= 1;
+            result += bit;
+        }
+    }
+    return result;
+}
+
+UInt32 fixedExp2(SInt32 y)
+{
+    // y must be <= 0 (result <= 1.0)
+    SInt32 ip = y >> 16;
+    UInt32 frac = y & 0xFFFF;
+    UInt64 result = 1ULL<<30;
+    for (unsigned i = 0; i < countof(fixedExp2Table); i++)
+    {
+        if (frac & (0x8000 >> i))
+            result = (result * fixedExp2Table[i]) >> 30;
+    }
+    result >>= 14;
+    if (ip < -31)
+        return 0;
+    return (UInt32)(result >> -ip);
+}
+
+UInt32 fixedPow(UInt32 x, UInt32 exponent)
+{
+    // x in [0,1], exponent > 0
+    if (!x)
+        return 0;
+    SInt64 y = ((SInt64)fixedLog2(x) * exponent) >> 16;
+    if (y < -(32LL<<16))
+        return 0;
+    return fixedExp2((SInt32)y);
+}
+
+UInt32 easePosition(UInt32 easing, UInt32 t)
+{
+    // t and result are 16.16 fixed point in [0,1]
+    switch (easing)
+    {
+        case kEasingOut:
+            // 1-(1-t)^2
+            return (UInt32)(((UInt64)t * (2*kFixedOne - t)) >> 16);
+
+        case kEasingInOut:
+            // 2t^2 for first half, 1-2(1-t)^2 for second half
+            if (t < kFixedOne/2)
+                return (UInt32)(((UInt64)t * t) >> 15);
+            t = kFixedOne - t;
+            return kFixedOne - (UInt32)(((UInt64)t * t) >> 15);
+    }
+    return t;
+}
+
+void generateCurve(UInt32* levels, UInt32 count, UInt32 min, UInt32 max, UInt32 gamma)
+{
+    // count >= 3, min <= max
+    levels[0] = 0;
+    for (UInt32 i = 1; i < count; i++)
+    {
+        UInt32 x = (UInt32)(((UInt64)(i-1) << 16) / (count-2));
+        levels[i] = min + (UInt32)(((UInt64)(max-min) * fixedPow(x, gamma) + kFixedOne/2) >> 16);
+    }
+}
+
+UInt32 scaleLevel(UInt32 value, UInt32 to, UInt32 from, bool round)
+{
+    if (!round)
+        return (UInt32)((UInt64)value * to / from);
+    return (UInt32)(((UInt64)value * to + from/2) / from);
+}
+
+UInt32 levelIndexForLevel(UInt32 level, UInt32 count, UInt32* rem)
+{
+    UInt32 index = level * (count-1);
+    if (rem)
+        *rem = index % kBacklightLevelMax;
+    index = index / kBacklightLevelMax;
+    return index;
+}
+
+UInt32 levelForLevelIndex(UInt32 index, UInt32 count)
+{
+    // not really possible, but quiets the static analyzer...
+    if (count < 2) return 0;
+    UInt32 max = count-1;
+    UInt32 level = (index * kBacklightLevelMax + max/2) / max;
+    return level;
+}
+
+UInt32 rawForLevel(const UInt32* levels, UInt32 count, UInt32 level, UInt32 min, UInt32 max, bool round)
+{
+    UInt32 rem;
+    UInt32 index = levelIndexForLevel(level, count, &rem);
+    UInt32 value = levels[index];
+
+    // can set "in between" level
+    UInt32 next = index+1;
+    if (next < count)
+    {
+        // prorate the difference...
+        if (!round)
+        {
+            UInt32 diff = levels[next] - value;
+            value += (diff * rem) / kBacklightLevelMax;
+        }
+        else
+        {
+            // table may dip, so difference is signed
+            SInt64 diff = (SInt64)levels[next] - value;
+            diff *= rem;
+            diff += diff < 0 ? -kBacklightLevelMax/2 : kBacklightLevelMax/2;
+            value += (SInt32)(diff / kBacklightLevelMax);
+        }
+    }
+
+    // adjust level to within limits set by XRGL and XRGH
+    if (value > max)
+        value = max;
+    if (value && value < min)
+        value = min;
+
+    return value;
+}
+
+UInt32 rawForFixedLevel(const UInt32* levelToRaw, UInt32 fixedLevel)
+{
+    UInt32 index = fixedLevel >> 16;
+    UInt32 frac = fixedLevel & 0xFFFF;
+    if (!frac || index >= kBacklightLevelMax)
+        return levelToRaw[index];
+    SInt64 diff = (SInt64)levelToRaw[index+1] - levelToRaw[index];
+    return levelToRaw[index] + (SInt32)((diff * frac + (diff < 0 ? -kFixedOne/2 : kFixedOne/2)) / kFixedOne);
+}
+
+void buildMonotonicLevels(UInt32* monotonic, const UInt32* levels, UInt32 count)
+{
+    // For a monotonic table the result is identical, and for a user supplied
+    // table with dips the first entry above any raw value is the same in
+    // both, so binary search gives the same index a linear scan would.
+    UInt32 high = 0;
+    for (UInt32 i = 0; i < count; i++)
+    {
+        if (levels[i] > high)
+            high = levels[i];
+        monotonic[i] = high;
+    }
+}
+
+UInt32 findLevelIndex(const UInt32* monotonic, UInt32 count, UInt32 raw)
+{
+    // binary search for first entry greater than raw
+    UInt32 lo = 0, hi = count;
+    while (lo < hi)
+    {
+        UInt32 mid = (lo + hi) >> 1;
+        if (raw < monotonic[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    // index is entry just before that (below first entry maps to zero)
+    return lo ? lo-1 : 0;
+}
+
+UInt32 levelForRaw(const UInt32* monotonic, UInt32 count, UInt32 raw)
+{
+    // return approx. OS X level for raw value
+    UInt32 index = findLevelIndex(monotonic, count, raw);
+    UInt32 level = levelForLevelIndex(index, count);
+    if (index < count-1)
+    {
+        // pro-rate between levels
+        int diff = levelForLevelIndex(index+1, count) - level;
+        if (monotonic[index+1] != monotonic[index] && raw > monotonic[index])
+        {
+            // now pro-rate diff for raw as between monotonic[index] and monotonic[index+1]
+            level += (UInt32)((UInt64)diff * (raw - monotonic[index]) / (monotonic[index+1] - monotonic[index]));
+        }
+    }
+    return level;
+}
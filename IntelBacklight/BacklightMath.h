@@ -0,0 +1,59 @@
+//
+//  BacklightMath.h
+//
+
+#ifndef _BACKLIGHT_MATH_H
+#define _BACKLIGHT_MATH_H
+
+#include <libkern/OSTypes.h>
+
+// Level conversions between OS X brightness (0..kBacklightLevelMax), index
+// into the level table and raw PWM values.  Only plain integers and arrays
+// are used (no IOKit, no floating point), so these can also be built into a
+// user space tool against libkern/OSTypes.h.
+
+#define kBacklightLevelMin  0
+#define kBacklightLevelMax  0x400
+
+enum { kEasingLinear = 0, kEasingOut = 1, kEasingInOut = 2, };
+
+// fixed point (16.16) helpers, as kernel code cannot use floating point
+#define kFixedOne 0x10000
+
+SInt32 fixedLog2(UInt32 x);
+UInt32 fixedExp2(SInt32 y);
+UInt32 fixedPow(UInt32 x, UInt32 exponent);
+
+// position along a transition for t in [0,1] (both 16.16)
+UInt32 easePosition(UInt32 easing, UInt32 t);
+
+// levels[0] = 0, levels[i] = min + (max-min) * ((i-1)/(count-2))^gamma
+void generateCurve(UInt32* levels, UInt32 count, UInt32 min, UInt32 max, UInt32 gamma);
+
+// value * to / from, as used to rescale level tables to PWM max
+// (round is false for the truncating 16-bit behaviour)
+UInt32 scaleLevel(UInt32 value, UInt32 to, UInt32 from, bool round = true);
+
+// OS X level -> table index (rem is remainder for prorating to next entry)
+UInt32 levelIndexForLevel(UInt32 level, UInt32 count, UInt32* rem);
+
+// table index -> OS X level (rounded)
+UInt32 levelForLevelIndex(UInt32 index, UInt32 count);
+
+// OS X level -> raw, prorated between table entries and clamped to [min,max]
+// (zero stays zero)
+UInt32 rawForLevel(const UInt32* levels, UInt32 count, UInt32 level, UInt32 min, UInt32 max, bool round = true);
+
+// raw for OS X level in 16.16 fixed point, between levelToRaw entries
+UInt32 rawForFixedLevel(const UInt32* levelToRaw, UInt32 fixedLevel);
+
+// running maximum of levels, which makes it usable for binary search
+void buildMonotonicLevels(UInt32* monotonic, const UInt32* levels, UInt32 count);
+
+// index of last entry in monotonic table not greater than raw (0 if below first)
+UInt32 findLevelIndex(const UInt32* monotonic, UInt32 count, UInt32 raw);
+
+// raw -> approx. OS X level using monotonic table
+UInt32 levelForRaw(const UInt32* monotonic, UInt32 count, UInt32 raw);
+
+#endif // _BACKLIGHT_MATH_H
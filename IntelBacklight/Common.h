@@ -9,4 +9,18 @@
 #define EXPORT __attribute__((visibility("default")))
 #define PRIVATE __attribute__((visibility("hidden"))) NOINLINE
 
+#ifdef __cplusplus
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+
+static inline void setDictNumber(OSDictionary* dict, const char* key, UInt64 value, unsigned bits = 32)
+{
+    if (OSNumber* num = OSNumber::withNumber(value, bits))
+    {
+        dict->setObject(key, num);
+        num->release();
+    }
+}
+#endif
+
 #endif // _COMMON_H
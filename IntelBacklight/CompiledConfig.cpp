@@ -0,0 +1,146 @@
+//
+//  CompiledConfig.cpp
+//
+
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSString.h>
+#include <libkern/c++/OSCollectionIterator.h>
+
+#include "Debug.h"
+#include "Common.h"
+#include "CompiledConfig.h"
+#include "BacklightMath.h"
+
+UInt32 fingerprintBytes(const void* bytes, unsigned length, UInt32 hash)
+{
+    const UInt8* p = (const UInt8*)bytes;
+    for (unsigned i = 0; i < length; i++)
+    {
+        hash ^= p[i];
+        hash *= kFNVPrime;
+    }
+    return hash;
+}
+
+UInt32 fingerprintACPITables(OSDictionary* tables, UInt32 hash)
+{
+    // the header checksum changes whenever a table body does, and signature
+    // plus OEM table id tell tables apart; tables are combined by sum, so
+    // iteration order does not matter, and hashed a word at a time
+    UInt32 sum = 0;
+    if (tables)
+    {
+        if (OSCollectionIterator* iter = OSCollectionIterator::withCollection(tables))
+        {
+            while (OSString* key = OSDynamicCast(OSString, iter->getNextObject()))
+            {
+                OSData* table = OSDynamicCast(OSData, tables->getObject(key));
+                if (!table || table->getLength() < kACPITableHeaderSize)
+                    continue;
+                UInt32 header[kACPITableHeaderSize/sizeof(UInt32)];
+                memcpy(header, table->getBytesNoCopy(), sizeof(header));
+                UInt32 entry = kFNVOffsetBasis;
+                for (unsigned i = 0; i < sizeof(header)/sizeof(header[0]); i++)
+                    entry = (entry ^ header[i]) * kFNVPrime;
+                sum += entry;
+            }
+            iter->release();
+        }
+    }
+    return fingerprintBytes(&sum, sizeof(sum), hash);
+}
+
+OSData* packCompiledConfig(const BacklightConfig* config, UInt32 fingerprint)
+{
+    if (config->m_nLevels > kCompiledConfigMaxLevels || !config->m_backlightLevels)
+        return NULL;
+
+    CompiledConfigHeader header;
+    memset(&header, 0, sizeof(header));
+    header.m_magic = kCompiledConfigMagic;
+    header.m_version = kCompiledConfigVersion;
+    header.m_nLevels = config->m_nLevels;
+    header.m_fingerprint = fingerprint;
+    header.m_pwmMax = config->m_pwmMax;
+    header.m_pchlInit = config->m_pchlInit;
+    header.m_levwInit = config->m_levwInit;
+    header.m_options = config->m_options;
+    header.m_backlightMin = config->m_backlightMin;
+    header.m_backlightMax = config->m_backlightMax;
+    header.m_backlightLevelsScale = config->m_backlightLevelsScale;
+    header.m_smoothDuration = config->m_smoothDuration;
+    header.m_smoothDurationMin = config->m_smoothDurationMin;
+    header.m_smoothInterval = config->m_smoothInterval;
+    header.m_smoothEasing = config->m_smoothEasing;
+    header.m_nvramSaveDelay = config->m_nvramSaveDelay;
+    header.m_wakeFadeDuration = config->m_wakeFadeDuration;
+
+    unsigned levelsSize = config->m_nLevels * sizeof(UInt32);
+    OSData* data = OSData::withCapacity(sizeof(header) + levelsSize);
+    if (!data)
+        return NULL;
+    if (!data->appendBytes(&header, sizeof(header)) || !data->appendBytes(config->m_backlightLevels, levelsSize))
+    {
+        data->release();
+        return NULL;
+    }
+    return data;
+}
+
+// same constraints loadConfiguration applies to what it produces, so a
+// damaged (or hand edited) blob is not used as is
+static bool validCompiledConfig(const CompiledConfigHeader* header)
+{
+    if (header->m_nLevels < 2 || header->m_nLevels > kCompiledConfigMaxLevels)
+        return false;
+    if (-1 == header->m_smoothDuration || -1 == header->m_smoothDurationMin)
+        return false;
+    if (-1 == header->m_smoothInterval || !header->m_smoothInterval)
+        return false;
+    if (header->m_smoothEasing > kEasingInOut)
+        return false;
+    if (-1 == header->m_nvramSaveDelay || -1 == header->m_wakeFadeDuration)
+        return false;
+    return true;
+}
+
+bool unpackCompiledConfig(OSData* data, UInt32 fingerprint, BacklightConfig* config)
+{
+    if (!data || data->getLength() < sizeof(CompiledConfigHeader))
+        return false;
+
+    CompiledConfigHeader header;
+    memcpy(&header, data->getBytesNoCopy(), sizeof(header));
+    if (kCompiledConfigMagic != header.m_magic || kCompiledConfigVersion != header.m_version)
+        return false;
+    if (fingerprint != header.m_fingerprint)
+        return false;
+    unsigned levelsSize = header.m_nLevels * sizeof(UInt32);
+    if (!validCompiledConfig(&header) || data->getLength() != sizeof(header) + levelsSize)
+    {
+        DebugLog("compiled configuration is not valid, using full parse\n");
+        return false;
+    }
+
+    UInt32* levels = new UInt32[header.m_nLevels];
+    if (!levels)
+        return false;
+    memcpy(levels, (const UInt8*)data->getBytesNoCopy() + sizeof(header), levelsSize);
+
+    config->m_pwmMax = header.m_pwmMax;
+    config->m_pchlInit = header.m_pchlInit;
+    config->m_levwInit = header.m_levwInit;
+    config->m_options = header.m_options;
+    config->m_backlightMin = header.m_backlightMin;
+    config->m_backlightMax = header.m_backlightMax;
+    config->m_backlightLevelsScale = header.m_backlightLevelsScale;
+    config->m_smoothDuration = header.m_smoothDuration;
+    config->m_smoothDurationMin = header.m_smoothDurationMin;
+    config->m_smoothInterval = header.m_smoothInterval;
+    config->m_smoothEasing = header.m_smoothEasing;
+    config->m_nvramSaveDelay = header.m_nvramSaveDelay;
+    config->m_wakeFadeDuration = header.m_wakeFadeDuration;
+    config->m_nLevels = header.m_nLevels;
+    config->m_backlightLevels = levels;
+    return true;
+}
@@ -0,0 +1,67 @@
+//
+//  CompiledConfig.h
+//
+
+#ifndef _COMPILED_CONFIG_H
+#define _COMPILED_CONFIG_H
+
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSData.h>
+#include "Configuration.h"
+
+// A BacklightConfig as produced by loadConfiguration, stored in NVRAM
+// together with a fingerprint of the inputs it was built from.  The inputs
+// are keyed by cheap stand-ins rather than hashed whole: the kext version
+// covers the handler Configuration (it ships in Info.plist), the ACPI table
+// headers cover RMCF, plus the handler's framebuffer type and the hardware
+// PWM max.  When the fingerprint matches, the blob is used instead of
+// evaluating and translating RMCF and parsing the merged configuration.
+
+#define kCompiledConfigMagic        0x43434249  // 'IBCC'
+#define kCompiledConfigVersion      4
+#define kCompiledConfigMaxLevels    256         // keeps NVRAM footprint small
+
+#define kFNVOffsetBasis             0x811C9DC5
+#define kFNVPrime                   0x01000193
+
+struct CompiledConfigHeader
+{
+    UInt32 m_magic;
+    UInt16 m_version;
+    UInt16 m_nLevels;
+    UInt32 m_fingerprint;
+    UInt32 m_pwmMax;
+    UInt32 m_pchlInit;
+    UInt32 m_levwInit;
+    UInt32 m_options;
+    UInt32 m_backlightMin;
+    UInt32 m_backlightMax;
+    UInt32 m_backlightLevelsScale;
+    UInt32 m_smoothDuration;
+    UInt32 m_smoothDurationMin;
+    UInt32 m_smoothInterval;
+    UInt32 m_smoothEasing;
+    UInt32 m_nvramSaveDelay;
+    UInt32 m_wakeFadeDuration;
+    // followed by UInt32 levels[m_nLevels]
+};
+
+// FNV-1a over bytes, continuing from hash
+UInt32 fingerprintBytes(const void* bytes, unsigned length, UInt32 hash);
+
+// FNV-1a (by word) over the header (signature, length, checksum, OEM ids,
+// revisions) of each table in the platform expert's "ACPI Tables"; table
+// order does not matter
+#define kACPITablesKey              "ACPI Tables"
+#define kACPITableHeaderSize        36
+
+UInt32 fingerprintACPITables(OSDictionary* tables, UInt32 hash);
+
+// NULL if config is not cacheable (too many levels) or no memory
+OSData* packCompiledConfig(const BacklightConfig* config, UInt32 fingerprint);
+
+// fills config (allocating m_backlightLevels) if data is a valid blob for
+// fingerprint and its fields pass the checks loadConfiguration applies
+bool unpackCompiledConfig(OSData* data, UInt32 fingerprint, BacklightConfig* config);
+
+#endif // _COMPILED_CONFIG_H
@@ -0,0 +1,307 @@
+//
+//  Configuration.cpp
+//
+
+#include <libkern/c++/OSBoolean.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+
+#include "Debug.h"
+#include "Common.h"
+#include "Configuration.h"
+
+#define kDefaultCurveCount  65
+#define kDefaultCurveGamma  0x20000
+
+#define kDefaultSmoothDuration      500
+#define kDefaultSmoothDurationMin   150
+#define kDefaultSmoothInterval      10
+#define kDefaultSmoothEasing        kEasingOut
+
+#define kDefaultNVRAMSaveDelay      1000
+#define kDefaultWakeFadeDuration    0
+
+static UInt32 getConfigInteger32(OSDictionary* dict, const char* key)
+{
+    UInt32 result = -1;
+    if (OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(key)))
+        result = num->unsigned32BitValue();
+    else
+        DebugLog("getConfigInteger32: %s is not a number\n", key);
+    return result;
+}
+
+static bool loadCurve(BacklightConfig* cfg, OSDictionary* curve)
+{
+    // BacklightCurve generates levels as:
+    //  levels[0] = 0
+    //  levels[i] = Min + (Max-Min) * ((i-1)/(Count-2))^Gamma
+    // Gamma is 16.16 fixed point (0x20000 is 2.0)
+    UInt32 count = getConfigInteger32(curve, "Count");
+    UInt32 min = getConfigInteger32(curve, "Min");
+    UInt32 max = getConfigInteger32(curve, "Max");
+    UInt32 gamma = getConfigInteger32(curve, "Gamma");
+    if (-1 == count)
+        count = kDefaultCurveCount;
+    if (-1 == min)
+        min = cfg->m_backlightMin;
+    if (-1 == max)
+        max = cfg->m_backlightMax;
+    if (-1 == gamma || !gamma)
+        gamma = kDefaultCurveGamma;
+    if (count < 3 || count > kBacklightLevelMax+1 || min > max)
+    {
+        AlwaysLog("BacklightCurve invalid (Count=%u, Min=%u, Max=%u)\n", count, min, max);
+        return false;
+    }
+
+    cfg->m_backlightLevels = new UInt32[count];
+    if (!cfg->m_backlightLevels)
+        return false;
+    generateCurve(cfg->m_backlightLevels, count, min, max, gamma);
+    cfg->m_nLevels = count;
+    return true;
+}
+
+bool loadConfiguration(BacklightConfig* cfg, OSDictionary* config)
+{
+    // simple params
+    cfg->m_pwmMax = getConfigInteger32(config, "PWMMax");
+    cfg->m_pchlInit = getConfigInteger32(config, "PCHLInit");
+    cfg->m_levwInit = getConfigInteger32(config, "LEVWInit");
+    cfg->m_options = getConfigInteger32(config, "Options");
+    cfg->m_backlightMin = getConfigInteger32(config, "BacklightMin");
+    cfg->m_backlightMax = getConfigInteger32(config, "BacklightMax");
+    cfg->m_backlightLevelsScale = getConfigInteger32(config, "BacklightLevelsScale");
+
+    // smooth transition params (all optional)
+    cfg->m_smoothDuration = getConfigInteger32(config, "SmoothDuration");
+    if (-1 == cfg->m_smoothDuration)
+        cfg->m_smoothDuration = kDefaultSmoothDuration;
+    cfg->m_smoothDurationMin = getConfigInteger32(config, "SmoothDurationMin");
+    if (-1 == cfg->m_smoothDurationMin)
+        cfg->m_smoothDurationMin = kDefaultSmoothDurationMin;
+    cfg->m_smoothInterval = getConfigInteger32(config, "SmoothInterval");
+    if (-1 == cfg->m_smoothInterval || !cfg->m_smoothInterval)
+        cfg->m_smoothInterval = kDefaultSmoothInterval;
+    cfg->m_smoothEasing = getConfigInteger32(config, "SmoothEasing");
+    if (cfg->m_smoothEasing > kEasingInOut)
+        cfg->m_smoothEasing = kDefaultSmoothEasing;
+    cfg->m_nvramSaveDelay = getConfigInteger32(config, "NVRAMSaveDelay");
+    if (-1 == cfg->m_nvramSaveDelay)
+        cfg->m_nvramSaveDelay = kDefaultNVRAMSaveDelay;
+    cfg->m_wakeFadeDuration = getConfigInteger32(config, "WakeFadeDuration");
+    if (-1 == cfg->m_wakeFadeDuration)
+        cfg->m_wakeFadeDuration = kDefaultWakeFadeDuration;
+    
+    // BacklightCurve takes precedence over BacklightLevels
+    if (OSDictionary* curve = OSDynamicCast(OSDictionary, config->getObject("BacklightCurve")))
+    {
+        if (loadCurve(cfg, curve))
+            return true;
+        // fall through to BacklightLevels if curve is not usable
+    }
+
+    // handle BacklightLevels in both OSData or OSArray format
+    OSObject* obj = config->getObject("BacklightLevels");
+    if (OSData* data = OSDynamicCast(OSData, obj))
+    {
+        // allocate
+        UInt16* levels = (UInt16*)data->getBytesNoCopy();
+        int count = data->getLength() / sizeof(UInt16);
+        cfg->m_backlightLevels = new UInt32[count];
+        if (!cfg->m_backlightLevels)
+            return false;
+        // byte swap copy
+        for (int i = 0; i < count; i++)
+            cfg->m_backlightLevels[i] = (UInt16)((levels[i] << 8) | (levels[i] >> 8));
+        cfg->m_nLevels = count;
+    }
+    else if (OSArray* array = OSDynamicCast(OSArray, obj))
+    {
+        // allocate
+        int count = array->getCount();
+        cfg->m_backlightLevels = new UInt32[count];
+        if (!cfg->m_backlightLevels)
+            return false;
+        // copy from numbers in array
+        for (int i = 0; i < count; i++)
+        {
+            OSNumber* num = OSDynamicCast(OSNumber, array->getObject(i));
+            if (num)
+                cfg->m_backlightLevels[i] = (cfg->m_options & kLevels16Bit) ? num->unsigned16BitValue() : num->unsigned32BitValue();
+        }
+        cfg->m_nLevels = count;
+    }
+    return cfg->m_nLevels >= 2;
+}
+
+static OSObject* translateEntry(OSObject* obj)
+{
+    // Note: non-NULL result is retained...
+    
+    // if object is another array, translate it
+    if (OSArray* array = OSDynamicCast(OSArray, obj))
+        return translateArray(array);
+    
+    // if object is a string, may be translated to boolean
+    if (OSString* string = OSDynamicCast(OSString, obj))
+    {
+        // object is string, translate special boolean values
+        const char* sz = string->getCStringNoCopy();
+        if (sz[0] == '>')
+        {
+            // boolean types true/false
+            if (sz[1] == 'y' && !sz[2])
+                return OSBoolean::withBoolean(true);
+            else if (sz[1] == 'n' && !sz[2])
+                return OSBoolean::withBoolean(false);
+            // escape case ('>>n' '>>y'), replace with just string '>n' '>y'
+            else if (sz[1] == '>' && (sz[2] == 'y' || sz[2] == 'n') && !sz[3])
+                return OSString::withCString(&sz[1]);
+        }
+    }
+    return NULL; // no translation
+}
+
+OSObject* translateArray(OSArray* array)
+{
+    // may return either OSArray* or OSDictionary*
+    
+    int count = array->getCount();
+    if (!count)
+        return NULL;
+    
+    OSObject* result = array;
+    
+    // if first entry is an empty array, process as array, else dictionary
+    OSArray* test = OSDynamicCast(OSArray, array->getObject(0));
+    if (test && test->getCount() == 0)
+    {
+        // using same array, but translating it...
+        array->retain();
+        
+        // remove bogus first entry
+        array->removeObject(0);
+        --count;
+        
+        // translate entries in the array
+        for (int i = 0; i < count; ++i)
+        {
+            if (OSObject* obj = translateEntry(array->getObject(i)))
+            {
+                array->replaceObject(i, obj);
+                obj->release();
+            }
+        }
+    }
+    else
+    {
+        // array is key/value pairs, so must be even
+        if (count & 1)
+            return NULL;
+        
+        // dictionary constructed to accomodate all pairs
+        int size = count >> 1;
+        if (!size) size = 1;
+        OSDictionary* dict = OSDictionary::withCapacity(size);
+        if (!dict)
+            return NULL;
+        
+        // go through each entry two at a time, building the dictionary
+        for (int i = 0; i < count; i += 2)
+        {
+            OSString* key = OSDynamicCast(OSString, array->getObject(i));
+            if (!key)
+            {
+                dict->release();
+                return NULL;
+            }
+            // get value, use translated value if translated
+            OSObject* obj = array->getObject(i+1);
+            OSObject* trans = translateEntry(obj);
+            if (trans)
+                obj = trans;
+            dict->setObject(key, obj);
+            OSSafeRelease(trans);
+        }
+        result = dict;
+    }
+    
+    // Note: result is retained when returned...
+    return result;
+}
+
+OSDictionary* getConfigurationOverride(OSObject* r)
+{
+    // r is the result of evaluating the configuration method (RMCF)
+
+    // for translation method must return array
+    OSObject* obj = NULL;
+    OSArray* array = OSDynamicCast(OSArray, r);
+    if (array)
+        obj = translateArray(array);
+
+    // must be dictionary after translation, even though array is possible
+    OSDictionary* result = OSDynamicCast(OSDictionary, obj);
+    if (!result)
+    {
+        OSSafeRelease(obj);
+        return NULL;
+    }
+    return result;
+}
+
+BacklightTables::BacklightTables()
+{
+    memset(&m_config, 0, sizeof(m_config));
+    m_source = NULL;
+    m_pwmMax = 0;
+    m_scaledLevels = NULL;
+    m_scaledMin = m_scaledMax = 0;
+    m_inverseLevels = NULL;
+}
+
+BacklightTables::~BacklightTables()
+{
+    delete[] m_config.m_backlightLevels;
+    delete[] m_scaledLevels;
+    delete[] m_inverseLevels;
+    OSSafeRelease(m_source);
+}
+
+bool buildLookupTables(BacklightTables* tables, UInt32 pwmMax)
+{
+    // called before tables are published, again from installTables only if
+    // initBacklight settled on a different PWM max (arrays already allocated)
+
+    const BacklightConfig& config = tables->m_config;
+    if (!tables->m_scaledLevels)
+        tables->m_scaledLevels = new UInt32[config.m_nLevels];
+    if (!tables->m_inverseLevels)
+        tables->m_inverseLevels = new UInt32[config.m_nLevels];
+    if (!tables->m_scaledLevels || !tables->m_inverseLevels)
+        return false;
+    tables->m_pwmMax = pwmMax;
+
+    // scaled copy of configured levels (rounded, unless 16-bit compatibility)
+    bool round = !(config.m_options & kLevels16Bit);
+    UInt32 mask = round ? 0xFFFFFFFF : 0xFFFF;
+    UInt32 scale = config.m_backlightLevelsScale;
+    if (pwmMax == scale || !scale)
+        pwmMax = scale = 1;
+    for (int i = 0; i < config.m_nLevels; i++)
+        tables->m_scaledLevels[i] = scaleLevel(config.m_backlightLevels[i], pwmMax, scale, round) & mask;
+    tables->m_scaledMin = scaleLevel(config.m_backlightMin, pwmMax, scale, round) & mask;
+    tables->m_scaledMax = scaleLevel(config.m_backlightMax, pwmMax, scale, round) & mask;
+
+    // inverse table is the running maximum of m_scaledLevels
+    buildMonotonicLevels(tables->m_inverseLevels, tables->m_scaledLevels, config.m_nLevels);
+
+    // every OS X level maps to a raw value with same math (and clamps) as before
+    for (UInt32 level = 0; level <= kBacklightLevelMax; level++)
+        tables->m_levelToRaw[level] = rawForLevel(tables->m_scaledLevels, config.m_nLevels, level, tables->m_scaledMin, tables->m_scaledMax, round);
+
+    return true;
+}
@@ -0,0 +1,74 @@
+//
+//  Configuration.h
+//
+
+#ifndef _CONFIGURATION_H
+#define _CONFIGURATION_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSDictionary.h>
+
+#include "BacklightMath.h"
+
+// Configuration from the handler personality (Info.plist) merged with RMCF,
+// and the lookup tables IntelBacklightPanel derives from it.  Only libkern
+// containers are used, so this is also built into the host tool (host/).
+
+enum { kDisableSmooth = 0x01, kWriteLEVWOnSet = 0x02, kLevels16Bit = 0x04, };
+
+struct BacklightConfig
+{
+    UInt32 m_pwmMax;
+    UInt32 m_pchlInit;
+    UInt32 m_levwInit;
+    UInt32 m_options;
+    UInt32 m_backlightMin;
+    UInt32 m_backlightMax;
+    UInt32 m_backlightLevelsScale;
+    UInt16 m_nLevels;
+    UInt32* m_backlightLevels;
+    UInt32 m_smoothDuration;    // ms for full range transition
+    UInt32 m_smoothDurationMin; // ms for any transition
+    UInt32 m_smoothInterval;    // ms between steps
+    UInt32 m_smoothEasing;
+    UInt32 m_nvramSaveDelay;    // ms of quiet before writing NVRAM
+    UInt32 m_wakeFadeDuration;  // ms to restore level after wake (0 is immediate)
+};
+
+// Configuration and the tables derived from it.  Built outside the work loop
+// and published by swapping IntelBacklightPanel::m_tables on the work loop;
+// not modified once published (initBacklight settles m_pwmMax/m_pchlInit
+// just before).
+struct BacklightTables
+{
+    BacklightConfig m_config;   // levels/min/max as configured (not scaled)
+    OSDictionary* m_source;     // merged configuration loaded from (NULL if compiled)
+    UInt32 m_pwmMax;            // PWM max the scaled copies were built for
+    UInt32* m_scaledLevels;
+    UInt32 m_scaledMin, m_scaledMax;
+    UInt32* m_inverseLevels;    // monotonic copy of m_scaledLevels for raw->level
+    UInt32 m_levelToRaw[kBacklightLevelMax+1]; // OS X level->raw, clamps applied
+
+    BacklightTables();
+    ~BacklightTables();
+};
+
+// fills cfg from merged configuration (allocates m_backlightLevels),
+// missing optional values get their defaults
+bool loadConfiguration(BacklightConfig* cfg, OSDictionary* config);
+
+// RMCF package format: an array of key/value pairs is a dictionary, an
+// array starting with an empty array is an array, ">y"/">n" are booleans
+// (result is retained, array itself is translated in place)
+OSObject* translateArray(OSArray* array);
+
+// translated result of the configuration method (RMCF), retained, NULL if
+// it is not a dictionary after translation
+OSDictionary* getConfigurationOverride(OSObject* rmcf);
+
+// scaled copies of the configured levels for pwmMax and the dense level->raw
+// table (arrays are allocated on first use)
+bool buildLookupTables(BacklightTables* tables, UInt32 pwmMax);
+
+#endif // _CONFIGURATION_H
@@ -0,0 +1,96 @@
+//
+//  DisplayParams.cpp
+//
+
+#include <IOKit/graphics/IODisplay.h>
+
+#include "Common.h"
+#include "BacklightMath.h"
+#include "DisplayParams.h"
+
+void DisplayParams::init()
+{
+    m_params = NULL;
+    resetStats();
+}
+
+void DisplayParams::release()
+{
+    OSSafeReleaseNULL(m_params);
+}
+
+bool DisplayParams::build(UInt32 value)
+{
+    OSDictionary* params = OSDictionary::withCapacity(2);
+    OSDictionary* commitParams = OSDictionary::withCapacity(1);
+    OSNumber* num = OSNumber::withNumber(0ULL, 32);
+    if (!params || !commitParams || !num)
+    {
+        OSSafeRelease(params);
+        OSSafeRelease(commitParams);
+        OSSafeRelease(num);
+        return false;
+    }
+    ++m_builds;
+
+    IODisplay::addParameter(params, gIODisplayBrightnessKey, kBacklightLevelMin, kBacklightLevelMax);
+    IODisplay::setParameter(params, gIODisplayBrightnessKey, value);
+    commitParams->setObject("reg", num);
+    params->setObject(gIODisplayParametersCommitKey, commitParams);
+    num->release();
+    commitParams->release();
+
+    // previous parameters may still be published, they stay as they are
+    OSSafeRelease(m_params);
+    m_params = params;
+    return true;
+}
+
+static bool hasNumber(OSDictionary* dict, const OSSymbol* key, UInt32 value)
+{
+    OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(key));
+    return num && num->unsigned32BitValue() == value;
+}
+
+OSDictionary* DisplayParams::publish(OSDictionary* current, UInt32 value)
+{
+    if (!m_params)
+        return NULL;
+
+    // other handlers on the display may have replaced the parameters since
+    // they were last published, so look at what the display has
+    OSDictionary* brightness = current ? OSDynamicCast(OSDictionary, current->getObject(gIODisplayBrightnessKey)) : NULL;
+    if (brightness && current->getObject(gIODisplayParametersCommitKey) &&
+        hasNumber(brightness, gIODisplayValueKey, value) &&
+        hasNumber(brightness, gIODisplayMinValueKey, kBacklightLevelMin) &&
+        hasNumber(brightness, gIODisplayMaxValueKey, kBacklightLevelMax))
+    {
+        ++m_unchanged;
+        return NULL;
+    }
+
+    if (!build(value))
+        return NULL;
+    ++m_publishes;
+    if (!current)
+    {
+        m_params->retain();
+        return m_params;
+    }
+    OSDictionary* result = OSDictionary::withDictionary(current);
+    if (result)
+        result->merge(m_params);
+    return result;
+}
+
+void DisplayParams::resetStats()
+{
+    m_builds = m_publishes = m_unchanged = 0;
+}
+
+void DisplayParams::addStats(OSDictionary* dict) const
+{
+    setDictNumber(dict, "Builds", m_builds);
+    setDictNumber(dict, "Publishes", m_publishes);
+    setDictNumber(dict, "Unchanged", m_unchanged);
+}
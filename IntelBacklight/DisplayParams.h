@@ -0,0 +1,44 @@
+//
+//  DisplayParams.h
+//
+
+#ifndef _DISPLAY_PARAMS_H
+#define _DISPLAY_PARAMS_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+
+// The brightness and commit parameters IntelBacklightPanel publishes on its
+// IODisplay.  Published dictionaries are never modified: a change builds a
+// new one, so registry readers (ioreg, serialize) never see a half updated
+// value.  Whether to publish is decided by what the display holds, and when
+// it already shows the value nothing is allocated.  No IOService calls, so
+// the host tool can count allocations on this path.
+
+class DisplayParams
+{
+public:
+    void init();
+    void release();
+
+    // brightness (min, max, value) and commit (reg) for value, in a new
+    // dictionary replacing the previous one
+    bool build(UInt32 value);
+    inline OSDictionary* getParams() const { return m_params; }
+
+    // NULL if current (the display's parameters) already shows value with
+    // our range and commit; otherwise parameters for value are built again
+    // and merged over current into a new dictionary for the display
+    // (retained, NULL if no memory)
+    OSDictionary* publish(OSDictionary* current, UInt32 value);
+
+    void resetStats();
+    void addStats(OSDictionary* dict) const;
+
+private:
+    OSDictionary* m_params;
+    UInt32 m_builds, m_publishes, m_unchanged;
+};
+
+#endif // _DISPLAY_PARAMS_H
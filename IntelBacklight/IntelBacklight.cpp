@@ -21,12 +21,18 @@
  */
 
 #include <IOKit/IOService.h>
+#include <IOKit/IOPlatformExpert.h>
 #include <IOKit/pci/IOPCIDevice.h>
 #include <libkern/version.h>
+#include <kern/clock.h>
 
 #include <IOKit/IONVRAM.h>
 #include <IOKit/IOLib.h>
+#include <IOKit/IOMessage.h>
+#include <IOKit/IOUserClient.h>
 #include "IntelBacklight.h"
+#include "CompiledConfig.h"
+#include "Trace.h"
 #include "Debug.h"
 
 //REVIEW: avoids problem with Xcode 5.1.0 where -dead_strip eliminates these required symbols
@@ -41,60 +47,47 @@ void* _org_rehabman_dontstrip_[] =
 OSDefineMetaClassAndStructors(IntelBacklightPanel, IODisplayParameterHandler)
 
 #define kIntelBacklightLevel "intel-backlight-level"
+#define kIntelBacklightConfig "intel-backlight-config"
 #define kRawBrightness "RawBrightness"
+#define kResyncRegisters "ResyncRegisters"
+#define kResetStats "ResetStats"
+#define kSnapshotTrace "SnapshotTrace"
+#define kPWMMax "PWMMax"
+#define kReloadConfiguration "ReloadConfiguration"
+
+// setProperties commands, all of them reprogram hardware or drop state
+static const char* const s_commandKeys[] =
+{
+    kRawBrightness, kResyncRegisters, kResetStats, kSnapshotTrace,
+    kPWMMax, kReloadConfiguration,
+};
 
-#define kBacklightLevelMin  0
-#define kBacklightLevelMax  0x400
+#define kPanelID "PanelID"
 
-#ifdef DEBUG
-#define kSmoothDelta "SmoothDelta%d"
-#define kSmoothStep "SmoothStep%d"
-#define kSmoothTimeout "SmoothTimeout%d"
-#define kSmoothBufSize 16
-#endif
+#define kMailboxEmpty   0xFFFFFFFF
 
-#define countof(x) (sizeof(x)/sizeof(x[0]))
 #define abs(x) ((x) < 0 ? -(x) : (x));
 
-struct SmoothData
-{
-    int delta;
-    int step;
-    int timeout;
-};
+enum { kPowerStateOff = 0, kPowerStateOn, kPowerStateCount };
 
-struct SmoothData smoothData[] =
+static IOPMPowerState s_powerStates[kPowerStateCount] =
 {
-    0x10,   1,  10000,
-    0x40,   4,  10000,
-    0xFFFF, 16, 10000,
+    { kIOPMPowerStateVersion1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { kIOPMPowerStateVersion1, kIOPMPowerOn, kIOPMPowerOn, kIOPMPowerOn, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
-#define m_max   (m_config.m_nLevels-1)
-#define m_min   (0)
-
-IORecursiveLock* IntelBacklightPanel::m_lock;
-
 extern "C"
 {
 
 __attribute__((visibility("hidden")))
 kern_return_t IntelBacklight_Start(kmod_info_t* ki, void * d)
 {
-    if (!(IntelBacklightPanel::m_lock = IORecursiveLockAlloc()))
-        return KERN_FAILURE;
-
     return KERN_SUCCESS;
 }
 
 __attribute__((visibility("hidden")))
 kern_return_t IntelBacklight_Stop(kmod_info_t* ki, void * d)
 {
-    if (IntelBacklightPanel::m_lock)
-    {
-        IORecursiveLockFree(IntelBacklightPanel::m_lock);
-        IntelBacklightPanel::m_lock = NULL;
-    }
     return KERN_SUCCESS;
 }
 
@@ -112,16 +105,74 @@ bool IntelBacklightPanel::init()
     m_handler = NULL;
     m_display = NULL;
     m_provider = NULL;
+    m_panelID = 0;
+    m_levelKey[0] = m_configKey[0] = 0;
+    m_workLoop = NULL;
 
     m_workSource = NULL;
     m_smoothTimer = NULL;
     m_cmdGate = NULL;
-
-    memset(&m_config, 0, sizeof(m_config));
+    m_saveTimer = NULL;
+    m_sleepWakeNotifier = NULL;
+    m_nvramNotifier = NULL;
+    m_nvramLoaded = m_levelCommitted = false;
+    m_persistedValue = m_pendingSave = -1;
+    m_nvramRequested = m_nvramPerformed = 0;
+    m_prebootSaved = -1;
+    m_displayParams.init();
+    m_doUpdateCalls = 0;
+    m_smoothTicks = 0;
+    m_transitionsStarted = m_transitionsCompleted = m_transitionsRetargeted = 0;
+    m_transitionBegin = 0;
+    smoothFadeReset(&m_fade, 0, 0);
+    m_saveLatency.reset();
+    m_transitionDuration.reset();
+    m_tickJitter.reset();
+    m_integerSetLatency.reset();
+    memset(m_bootTime, 0, sizeof(m_bootTime));
+    m_startTime = 0;
+    m_ready = false;
+    m_compiledConfig = NULL;
+    m_compiledConfigDirty = false;
+    m_configPath = kConfigNone;
+    m_nvramReadPath = kNVRAMReadNone;
+
+    m_tables = NULL;
+    m_handlerConfig = NULL;
+    m_configReloads = 0;
+    m_poweredOff = false;
+    m_wakeStart = 0;
+    m_wakeCount = 0;
+    m_displayUsable = false;
+    m_displayWakeCount = 0;
+    m_lastWakeLatency = 0;
+    m_wakeLatency.reset();
+
+    m_mailbox = kMailboxEmpty;
+    m_lockAcquired = m_lockContended = 0;
+    m_lockWaitTime = m_lockMaxWaitTime = 0;
+    m_lockHoldTime = m_lockMaxHoldTime = 0;
+    m_lock = IOLockAlloc();
+    if (!m_lock)
+        return false;
 
 	return super::init();
 }
 
+void IntelBacklightPanel::free()
+{
+    m_displayParams.release();
+    OSSafeReleaseNULL(m_handlerConfig);
+    OSSafeReleaseNULL(m_compiledConfig);
+    OSSafeReleaseNULL(m_workLoop);
+    if (m_lock)
+    {
+        IOLockFree(m_lock);
+        m_lock = NULL;
+    }
+    super::free();
+}
+
 IOService* IntelBacklightPanel::probe(IOService* provider, SInt32* score)
 {
     DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
@@ -160,12 +211,23 @@ bool IntelBacklightPanel::start(IOService* provider)
         return false;
     }
 
+    UInt64 now;
+    clock_get_uptime(&m_startTime);
+
+    // PNLF _UID identifies this panel (and its handler)
+    if (kIOReturnSuccess != m_provider->evaluateInteger("_UID", &m_panelID))
+        m_panelID = 0;
+    setProperty(kPanelID, m_panelID, 32);
+    snprintf(m_levelKey, sizeof(m_levelKey), "%s-%x", kIntelBacklightLevel, m_panelID);
+    snprintf(m_configKey, sizeof(m_configKey), "%s-%x", kIntelBacklightConfig, m_panelID);
+
     m_hasSaveMethod = (kIOReturnSuccess == m_provider->validateObject("SAVE"));
 
     // add interrupt source for delayed actions...
     m_workSource = IOInterruptEventSource::interruptEventSource(this, OSMemberFunctionCast(IOInterruptEventAction, this, &IntelBacklightPanel::processWorkQueue));
     if (!m_workSource)
         return false;
+    m_workLoop = IOWorkLoop::workLoop();
     IOWorkLoop* workLoop = getWorkLoop();
     if (!workLoop)
     {
@@ -180,88 +242,162 @@ bool IntelBacklightPanel::start(IOService* provider)
     if (m_cmdGate)
         workLoop->addEventSource(m_cmdGate);
 
+    // timer for deferred NVRAM writes
+    m_saveTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &IntelBacklightPanel::flushSaves));
+    if (m_saveTimer)
+        workLoop->addEventSource(m_saveTimer);
+
     // initialize from properties
     OSDictionary* dict = getPropertyTable();
     setPropertiesGated(dict);
 
-#ifdef DEBUG
-    // write current values from smoothData
-    for (int i = 0; i < countof(smoothData); i++)
+    // load default brightness level, without waiting for IODTNVRAM
+    if (IORegistryEntry* nvram = IORegistryEntry::fromPath("/chosen/nvram", gIODTPlane))
     {
-        char buf[kSmoothBufSize];
-        snprintf(buf, sizeof(buf), kSmoothDelta, i);
-        setProperty(buf, smoothData[i].delta, 32);
-        snprintf(buf, sizeof(buf), kSmoothStep, i);
-        setProperty(buf, smoothData[i].step, 32);
-        snprintf(buf, sizeof(buf), kSmoothTimeout, i);
-        setProperty(buf, smoothData[i].timeout, 32);
+        DebugLog("have nvram from /chosen/nvram\n");
+        clock_get_uptime(&now);
+        m_bootTime[kBootNVRAMLocate] = now - m_startTime;
+        loadFromNVRAM(nvram);
+        nvram->release();
+    }
+    else
+    {
+        // probably booting w/ Clover, IODTNVRAM is published later
+        DebugLog("no /chosen/nvram, waiting for IODTNVRAM\n");
+        if (OSDictionary* matching = serviceMatching("IODTNVRAM"))
+        {
+            m_nvramNotifier = addMatchingNotification(gIOFirstPublishNotification, matching, &IntelBacklightPanel::onNVRAMPublished, this);
+            matching->release();
+        }
     }
-#endif
-
-    IORecursiveLockLock(m_lock);
 
-    // load and set default brightness level
-    UInt32 value = loadFromNVRAM();
-    DebugLog("loadFromNVRAM returns %d\n", value);
+    // wake restores PWM control registers and brightness (setPowerState)
+    PMinit();
+    m_provider->joinPMtree(this);
+    registerPowerDriver(this, s_powerStates, kPowerStateCount);
 
     // make the service available for clients like 'ioio' (and backlight handler!)
     registerService();
 
-    //REVIEW: 15 second wait here... probably more than needed...
-    // wait for backlight handler... will call setBacklightHandler during this wait
-    DebugLog("Waiting for BacklightHandler\n");
-    IOService* service = waitForMatchingService(serviceMatching("BacklightHandler2"));
-    OSSafeRelease(service);
-    if (!m_handler || m_config.m_nLevels < 2)
+    // backlight handler attaches through its matching notification and calls
+    // setBacklightHandler, which finishes startup on the work loop
+    clock_get_uptime(&now);
+    m_bootTime[kBootStart] = now - m_startTime;
+    publishBootTiming();
+
+	return true;
+}
+
+IOReturn IntelBacklightPanel::finishStart(BacklightTables* tables)
+{
+    // only called on the work loop, after backlight handler is set
+    // (tables built by setBacklightHandler, NULL to keep current tables)
+
+    if (m_ready || !m_handler)
     {
-        if (!m_handler)
-            AlwaysLog("backlight handler never showed up.\n");
-        else
-            AlwaysLog("backlight handler invalid configuration (nLevels=%d)\n", m_config.m_nLevels);
+        delete tables;
+        return kIOReturnSuccess;
+    }
 
-        IOSleep(5000); //REVIEW: in case of race condition between backlight handler (ugly!)
+    UInt64 now;
+    clock_get_uptime(&now);
+    m_bootTime[kBootHandlerAttach] = now - m_startTime;
 
-        stop(provider);
-        IORecursiveLockUnlock(m_lock);
-        return false;
+    if (!tables && !m_tables)
+    {
+        AlwaysLog("backlight handler has no valid configuration\n");
+        return kIOReturnBadArgument;
+    }
+
+    // configuration compiled on this boot is used on the next one
+    if (m_compiledConfigDirty)
+    {
+        saveNVRAMData(m_configKey, m_compiledConfig);
+        m_compiledConfigDirty = false;
     }
 
     // allow backlight handler to initialize the hardware
-    m_handler->initBacklight(&m_config);
+    UInt64 phaseStart = now;
+    if (tables)
+        installTables(tables);
+    else
+        m_handler->initBacklight(&m_tables->m_config);
+    clock_get_uptime(&now);
+    m_bootTime[kBootHandlerInit] = now - phaseStart;
 
-    // add timer for smooth fade ins
-    if (!(m_config.m_options & kDisableSmooth))
+    // add timer for smooth fade ins (kDisableSmooth may change on reload)
+    if (!m_smoothTimer)
     {
         m_smoothTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &IntelBacklightPanel::onSmoothTimer));
         if (m_smoothTimer)
-            workLoop->addEventSource(m_smoothTimer);
+            getWorkLoop()->addEventSource(m_smoothTimer);
     }
     
     // after backlight handler is in place, now we can manipulate backlight level
     UInt32 current = queryRawBrightnessLevel();
-    setProperty(kRawBrightness, current, 32);
 
-    m_committed_value = m_value = m_from_value = levelForValue(current);
-    DebugLog("current brightness: %d (%d)\n", m_from_value, current);
+    UInt32 value = m_persistedValue;
+    lockState();
+    m_committed_value = m_value = levelForValue(current);
+    smoothFadeReset(&m_fade, m_value, current);
+    DebugLog("current brightness: %d (%d)\n", m_fade.m_current, current);
     if (-1 != value)
     {
-        m_committed_value = value;
+        m_committed_value = m_value = value;
         DebugLog("setting to value from nvram %d\n", value);
-        setBrightnessLevelSmooth(value);
     }
     m_saved_value = m_committed_value;
+    m_ready = true;
+    unlockState();
 
-    IORecursiveLockUnlock(m_lock);
+    // fade to value from nvram happens on the work loop
+    if (-1 != value)
+        postBrightnessLevel(value);
+    else
+        m_workSource->interruptOccurred(0, 0, 0);
 
-	return true;
+    // pending NVRAM write must be flushed before sleep/restart/shutdown
+    // (once, finishStart runs again when the handler re-attaches)
+    if (!m_sleepWakeNotifier)
+        m_sleepWakeNotifier = registerPrioritySleepWakeInterest(&IntelBacklightPanel::onSleepWake, this);
+
+    clock_get_uptime(&now);
+    m_bootTime[kBootReady] = now - m_startTime;
+    publishBootTiming();
+
+    // display may have attached before we were ready
+    doUpdate();
+
+    return kIOReturnSuccess;
 }
 
 void IntelBacklightPanel::stop(IOService* provider)
 {
     DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
 
-    OSSafeReleaseNULL(m_display);
-    
+    if (m_display)
+    {
+        m_display->deRegisterInterestedDriver(this);
+        m_display->release();
+        m_display = NULL;
+    }
+
+    PMstop();
+
+    if (m_nvramNotifier)
+    {
+        m_nvramNotifier->remove();
+        m_nvramNotifier = NULL;
+    }
+    if (m_sleepWakeNotifier)
+    {
+        m_sleepWakeNotifier->remove();
+        m_sleepWakeNotifier = NULL;
+    }
+    // write out anything still pending
+    if (m_cmdGate)
+        m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &IntelBacklightPanel::flushSaves));
+
     IOWorkLoop* workLoop = getWorkLoop();
     if (workLoop)
     {
@@ -277,6 +413,13 @@ void IntelBacklightPanel::stop(IOService* provider)
             m_smoothTimer->release();
             m_smoothTimer = NULL;
         }
+        if (m_saveTimer)
+        {
+            m_saveTimer->cancelTimeout();
+            workLoop->removeEventSource(m_saveTimer);
+            m_saveTimer->release();
+            m_saveTimer = NULL;
+        }
         if (m_cmdGate)
         {
             workLoop->removeEventSource(m_cmdGate);
@@ -288,215 +431,136 @@ void IntelBacklightPanel::stop(IOService* provider)
     m_provider = NULL;
     m_handler = NULL;
 
-    if (m_config.m_backlightLevels)
+    if (m_tables)
     {
-        delete[] m_config.m_backlightLevels;
-        m_config.m_backlightLevels = NULL;
+        delete m_tables;
+        m_tables = NULL;
     }
 
     super::stop(provider);
 }
 
-static UInt32 getConfigInteger32(OSDictionary* dict, const char* key)
-{
-    UInt32 result = -1;
-    if (OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(key)))
-        result = num->unsigned32BitValue();
-    else
-        DebugLog("getConfigInteger32: %s is not a number\n", key);
-    return result;
-}
-
-bool IntelBacklightPanel::loadConfiguration(OSDictionary* config)
-{
-    // simple params
-    m_config.m_pwmMax = getConfigInteger32(config, "PWMMax");
-    m_config.m_pchlInit = getConfigInteger32(config, "PCHLInit");
-    m_config.m_levwInit = getConfigInteger32(config, "LEVWInit");
-    m_config.m_options = getConfigInteger32(config, "Options");
-    m_config.m_backlightMin = getConfigInteger32(config, "BacklightMin");
-    m_config.m_backlightMax = getConfigInteger32(config, "BacklightMax");
-    m_config.m_backlightLevelsScale = getConfigInteger32(config, "BacklightLevelsScale");
-    
-    // handle BacklightLevels in both OSData or OSArray format
-    OSObject* obj = config->getObject("BacklightLevels");
-    if (OSData* data = OSDynamicCast(OSData, obj))
-    {
-        // allocate
-        UInt16* levels = (UInt16*)data->getBytesNoCopy();
-        int count = data->getLength() / sizeof(UInt16);
-        m_config.m_backlightLevels = new UInt16[count];
-        if (!m_config.m_backlightLevels)
-            return false;
-        // byte swap copy
-        for (int i = 0; i < count; i++)
-            m_config.m_backlightLevels[i] = (levels[i] << 8) | (levels[i] >> 8);
-        m_config.m_nLevels = count;
-    }
-    else if (OSArray* array = OSDynamicCast(OSArray, obj))
-    {
-        // allocate
-        int count = array->getCount();
-        m_config.m_backlightLevels = new UInt16[count];
-        if (!m_config.m_backlightLevels)
-            return false;
-        // copy from numbers in array
-        for (int i = 0; i < count; i++)
-        {
-            OSNumber* num = OSDynamicCast(OSNumber, array->getObject(i));
-            if (num)
-                m_config.m_backlightLevels[i] = num->unsigned16BitValue();
-        }
-        m_config.m_nLevels = count;
-    }
-    return m_config.m_nLevels >= 2;
-}
-
-OSObject* IntelBacklightPanel::translateEntry(OSObject* obj)
+OSDictionary* IntelBacklightPanel::mergeConfiguration(OSDictionary* config, OSObject* rmcf)
 {
-    // Note: non-NULL result is retained...
-    
-    // if object is another array, translate it
-    if (OSArray* array = OSDynamicCast(OSArray, obj))
-        return translateArray(array);
-    
-    // if object is a string, may be translated to boolean
-    if (OSString* string = OSDynamicCast(OSString, obj))
+    // config with RMCF result merged in (result is retained)
+    OSDictionary* merged = NULL;
+    OSDictionary* custom = getConfigurationOverride(rmcf);
+    if (custom)
     {
-        // object is string, translate special boolean values
-        const char* sz = string->getCStringNoCopy();
-        if (sz[0] == '>')
-        {
-            // boolean types true/false
-            if (sz[1] == 'y' && !sz[2])
-                return OSBoolean::withBoolean(true);
-            else if (sz[1] == 'n' && !sz[2])
-                return OSBoolean::withBoolean(false);
-            // escape case ('>>n' '>>y'), replace with just string '>n' '>y'
-            else if (sz[1] == '>' && (sz[2] == 'y' || sz[2] == 'n') && !sz[3])
-                return OSString::withCString(&sz[1]);
-        }
+        DebugOnly(setProperty("Configuration.Override", custom));
+        merged = OSDictionary::withDictionary(config);
+        if (merged && !merged->merge(custom))
+            OSSafeReleaseNULL(merged);
+        custom->release();
     }
-    return NULL; // no translation
-}
-
-OSObject* IntelBacklightPanel::translateArray(OSArray* array)
-{
-    // may return either OSArray* or OSDictionary*
-    
-    int count = array->getCount();
-    if (!count)
-        return NULL;
-    
-    OSObject* result = array;
-    
-    // if first entry is an empty array, process as array, else dictionary
-    OSArray* test = OSDynamicCast(OSArray, array->getObject(0));
-    if (test && test->getCount() == 0)
+    if (!merged)
     {
-        // using same array, but translating it...
-        array->retain();
-        
-        // remove bogus first entry
-        array->removeObject(0);
-        --count;
-        
-        // translate entries in the array
-        for (int i = 0; i < count; ++i)
-        {
-            if (OSObject* obj = translateEntry(array->getObject(i)))
-            {
-                array->replaceObject(i, obj);
-                obj->release();
-            }
-        }
+        config->retain();
+        return config;
     }
-    else
-    {
-        // array is key/value pairs, so must be even
-        if (count & 1)
-            return NULL;
-        
-        // dictionary constructed to accomodate all pairs
-        int size = count >> 1;
-        if (!size) size = 1;
-        OSDictionary* dict = OSDictionary::withCapacity(size);
-        if (!dict)
-            return NULL;
-        
-        // go through each entry two at a time, building the dictionary
-        for (int i = 0; i < count; i += 2)
-        {
-            OSString* key = OSDynamicCast(OSString, array->getObject(i));
-            if (!key)
-            {
-                dict->release();
-                return NULL;
-            }
-            // get value, use translated value if translated
-            OSObject* obj = array->getObject(i+1);
-            OSObject* trans = translateEntry(obj);
-            if (trans)
-                obj = trans;
-            dict->setObject(key, obj);
-            OSSafeRelease(trans);
-        }
-        result = dict;
-    }
-    
-    // Note: result is retained when returned...
-    return result;
+    DebugOnly(setProperty("Configuration.Merged", merged));
+    return merged;
 }
 
-OSDictionary* IntelBacklightPanel::getConfigurationOverride(const char* method)
+IOWorkLoop* IntelBacklightPanel::getWorkLoop() const
 {
-    // attempt to get configuration data from provider
-    OSObject* r = NULL;
-    if (kIOReturnSuccess != m_provider->evaluateObject(method, &r))
-        return NULL;
-    
-    // for translation method must return array
-    OSObject* obj = NULL;
-    OSArray* array = OSDynamicCast(OSArray, r);
-    if (array)
-        obj = translateArray(array);
-    OSSafeRelease(r);
-
-    // must be dictionary after translation, even though array is possible
-    OSDictionary* result = OSDynamicCast(OSDictionary, obj);
-    if (!result)
-    {
-        OSSafeRelease(obj);
-        return NULL;
-    }
-    return result;
+    return m_workLoop;
 }
 
-void IntelBacklightPanel::setBacklightHandler(BacklightHandler2* handler, OSDictionary* config)
+bool IntelBacklightPanel::setBacklightHandler(BacklightHandler2* handler, OSDictionary* config)
 {
     // lifetime of backlight handler is guaranteed -- no need to retain
+    lockState();
+    if (handler && m_handler && handler != m_handler)
+    {
+        unlockState();
+        AlwaysLog("panel %x already has a backlight handler\n", m_panelID);
+        return false;
+    }
+    if (!handler)
+        m_ready = false;
     m_handler = handler;
+    // kept for ReloadConfiguration
+    if (config)
+        config->retain();
+    if (m_handlerConfig)
+        m_handlerConfig->release();
+    m_handlerConfig = config;
+    unlockState();
 
     // config/params provided when setting (not clearing) backlight handler
-    if (config)
+    BacklightTables* tables = NULL;
+    if (config && (tables = new BacklightTables))
     {
-        DebugOnly(setProperty("Configuration.Handler", config));
-        OSDictionary* merged = NULL;
-        OSDictionary* custom = getConfigurationOverride("RMCF");
-        if (custom)
+        UInt64 start, now;
+        clock_get_uptime(&start);
+
+        // fingerprint of everything the configuration is built from, keyed
+        // cheaply (see CompiledConfig.h) so a match costs less than parsing
+        extern kmod_info_t kmod_info;
+        UInt32 fingerprint = fingerprintBytes(kmod_info.version, strlen(kmod_info.version), kFNVOffsetBasis);
+        UInt32 fbtype = 0;
+        if (OSNumber* num = OSDynamicCast(OSNumber, handler->getProperty("kFrameBufferType")))
+            fbtype = num->unsigned32BitValue();
+        fingerprint = fingerprintBytes(&fbtype, sizeof(fbtype), fingerprint);
+        fingerprint = fingerprintACPITables(OSDynamicCast(OSDictionary, getPlatform()->getProperty(kACPITablesKey)), fingerprint);
+        UInt32 hardwarePWMMax = handler->getHardwarePWMMax();
+        fingerprint = fingerprintBytes(&hardwarePWMMax, sizeof(hardwarePWMMax), fingerprint);
+
+        // NVRAM may still be loading on the work loop (see nvramPublished)
+        lockState();
+        OSData* compiled = m_compiledConfig;
+        if (compiled)
+            compiled->retain();
+        unlockState();
+        if (unpackCompiledConfig(compiled, fingerprint, &tables->m_config))
         {
-            DebugOnly(setProperty("Configuration.Override", custom));
-            merged = OSDictionary::withDictionary(config);
-            if (merged && merged->merge(custom))
-            {
-                DebugOnly(setProperty("Configuration.Merged", merged));
-                config = merged;
-            }
-            custom->release();
+            DebugLog("using compiled configuration (fingerprint %08x)\n", fingerprint);
+            lockState();
+            m_configPath = kConfigCompiled;
+            unlockState();
+        }
+        else
+        {
+            // attempt to get configuration data from provider
+            OSObject* rmcf = NULL;
+            if (kIOReturnSuccess != m_provider->evaluateObject("RMCF", &rmcf))
+                rmcf = NULL;
+
+            DebugOnly(setProperty("Configuration.Handler", config));
+            tables->m_source = mergeConfiguration(config, rmcf);
+            loadConfiguration(&tables->m_config, tables->m_source);
+
+            // cache result for next boot (written from finishStart)
+            OSData* packed = packCompiledConfig(&tables->m_config, fingerprint);
+            lockState();
+            OSSafeReleaseNULL(m_compiledConfig);
+            m_compiledConfig = packed;
+            m_compiledConfigDirty = (NULL != m_compiledConfig);
+            m_configPath = kConfigFull;
+            unlockState();
+            OSSafeRelease(rmcf);
+        }
+        OSSafeRelease(compiled);
+
+        // lookup tables are built here too, finishStart only publishes them
+        if (!finishTables(tables, handler))
+        {
+            delete tables;
+            tables = NULL;
         }
-        loadConfiguration(config);
-        OSSafeRelease(merged);
+
+        clock_get_uptime(&now);
+        m_bootTime[kBootConfig] = now - start;
     }
+
+    // rest of startup needs the handler
+    if (m_handler && m_cmdGate)
+        m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &IntelBacklightPanel::finishStart), tables);
+    else
+        delete tables;
+
+    return true;
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
@@ -506,116 +570,134 @@ void IntelBacklightPanel::setBacklightHandler(BacklightHandler2* handler, OSDict
 
 UInt32 IntelBacklightPanel::indexForLevel(UInt32 value, UInt32* rem)
 {
-    UInt32 index = value * (m_max-m_min);
-    if (rem)
-        *rem = index % kBacklightLevelMax;
-    index = index / kBacklightLevelMax + m_min;
-    return index;
+    return levelIndexForLevel(value, m_tables->m_config.m_nLevels, rem);
 }
 
 UInt32 IntelBacklightPanel::levelForIndex(UInt32 index)
 {
-    // not really possible, but quiets the static analyzer...
-    if (m_max-m_min <= 0) return 0;
-    UInt32 value = ((index-m_min) * kBacklightLevelMax + (m_max-m_min)/2) / (m_max-m_min);
-    return value;
+    return levelForLevelIndex(index, m_tables->m_config.m_nLevels);
 }
 
 UInt32 IntelBacklightPanel::levelForValue(UInt32 value)
 {
     // return approx. OS X level for raw value
-    UInt32 index = findIndexForLevel(value);
-    UInt32 level = levelForIndex(index);
-    if (index < m_max)
-    {
-        // pro-rate between levels
-        int diff = levelForIndex(index+1) - level;
-        if (m_config.m_backlightLevels[index+1] != m_config.m_backlightLevels[index])
-        {
-            // now pro-rate diff for value as between m_backlightLevels[index] and m_backlightLevels[index+1]
-            diff *= value - m_config.m_backlightLevels[index];
-            diff /= m_config.m_backlightLevels[index+1] - m_config.m_backlightLevels[index];
-            level += diff;
-        }
-    }
-    return level;
+    return levelForRaw(m_tables->m_inverseLevels, m_tables->m_config.m_nLevels, value);
 }
 
 bool IntelBacklightPanel::setDisplay(IODisplay* display)
 {    
     DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
 
-    IORecursiveLockLock(m_lock);
+    lockState();
 
     // retain new display (also allow setting to same instance as previous)
     if (display)
         display->retain();
-    OSSafeRelease(m_display);
+    IODisplay* previous = m_display;
     m_display = display;
+    if (previous != display)
+        m_displayUsable = (NULL != display);
     if (m_display)
     {
         // automatically commit a non-zero value on display change
         if (m_value)
             m_saved_value = m_committed_value = m_value;
+        // static parts of the parameters are built once per attach
+        m_displayParams.build(m_committed_value);
+    }
+    else
+        m_displayParams.release();
+    bool ready = m_ready;
+    // display change may have reset PWM control registers
+    if (display && ready)
+        m_workPending |= kWorkResync;
+
+    unlockState();
+
+    // display sleep (without system sleep) may reset PWM control registers
+    // too, see powerStateDidChangeTo
+    if (previous != display)
+    {
+        if (previous)
+            previous->deRegisterInterestedDriver(this);
+        if (display)
+            display->registerInterestedDriver(this);
+    }
+    OSSafeRelease(previous);
+
+    // before startup finishes, finishStart takes care of the update
+    if (display && ready)
+    {
+        m_workSource->interruptOccurred(0, 0, 0);
         // update brightness levels
         doUpdate();
     }
 
-    IORecursiveLockUnlock(m_lock);
-
     return true;
 }
 
 bool IntelBacklightPanel::doIntegerSet(OSDictionary* params, const OSSymbol* paramName, UInt32 value)
 {
     bool result = true;
+    UInt32 post = kMailboxEmpty;
+    bool work = false;
+    UInt64 start;
+    clock_get_uptime(&start);
 
-    IORecursiveLockLock(m_lock);
+    lockState();
 
     //DebugLog("%s::%s(\"%s\", %d)\n", this->getName(), __FUNCTION__, paramName->getCStringNoCopy(), value);
     if ( gIODisplayBrightnessKey->isEqualTo(paramName))
     {   
+        traceEvent(m_panelID, kTraceSetRequest, value);
         //DebugLog("%s::%s(%s) map %d -> %d\n", this->getName(), __FUNCTION__, paramName->getCStringNoCopy(), value, indexForLevel(value));
         //REVIEW: workaround for Yosemite DP...
         if (value < 5 && m_value > 5)
         {
             //REVIEW: copied from commit case below...
             // setting to zero automatically commits prior value
-            UInt32 index = indexForLevel(m_value);
             m_committed_value = m_value;
-            // save to NVRAM in work loop
-            scheduleWork(kWorkSave|kWorkSetBrightness);
-            // save to BIOS nvram via ACPI
-            if (m_hasSaveMethod)
-                savePrebootBrightnessLevel(m_config.m_backlightLevels[index]);
+            // save to NVRAM (and BIOS via ACPI) in work loop
+            m_workPending |= kWorkSave|kWorkSetBrightness;
+            work = true;
         }
         if (0xFF == value)
         {
-            setBrightnessLevelSmooth(m_saved_value);
+            post = m_value = m_saved_value;
             result = false;
         }
         //REVIEW: end workaround...
         else
         {
-            setBrightnessLevelSmooth(value);
+            post = m_value = value;
             if (value > 5) // more hacks for Yosemite (don't save really low values)
                 m_saved_value = value;
         }
     }
     else if (gIODisplayParametersCommitKey->isEqualTo(paramName))
     {
-        UInt32 index = indexForLevel(m_value);
-        //DebugLog("%s::%s(%s) map %d -> %d\n", this->getName(), __FUNCTION__, paramName->getCStringNoCopy(), value, index);
+        //DebugLog("%s::%s(%s) map %d\n", this->getName(), __FUNCTION__, paramName->getCStringNoCopy(), value);
         m_committed_value = m_value;
+        if (m_ready)
+            m_levelCommitted = true;
+        traceEvent(m_panelID, kTraceCommit, m_committed_value);
         IODisplay::setParameter(params, gIODisplayBrightnessKey, m_committed_value);
-        // save to NVRAM in work loop
-        scheduleWork(kWorkSave|kWorkSetBrightness);
-        // save to BIOS nvram via ACPI
-        if (m_hasSaveMethod)
-            savePrebootBrightnessLevel(m_config.m_backlightLevels[index]);
+        // save to NVRAM (and BIOS via ACPI) in work loop
+        m_workPending |= kWorkSave|kWorkSetBrightness;
+        work = true;
     }
 
-    IORecursiveLockUnlock(m_lock);
+    UInt64 now, ns;
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now - start, &ns);
+    m_integerSetLatency.record(ns);
+    unlockState();
+
+    // hand off to work loop... caller never waits on fade or NVRAM
+    if (kMailboxEmpty != post)
+        postBrightnessLevel(post);
+    else if (work)
+        m_workSource->interruptOccurred(0, 0, 0);
 
     return result;
 }
@@ -630,67 +712,27 @@ bool IntelBacklightPanel::doDataSet(const OSSymbol* paramName, OSData* value )
 bool IntelBacklightPanel::doUpdate( void )
 {
     //DebugLog("enter %s::%s()\n", this->getName(), __FUNCTION__);
-    bool result = false;
 
-    IORecursiveLockLock(m_lock);
-
-    OSDictionary* newDict = 0;
-	OSDictionary* allParams = OSDynamicCast(OSDictionary, m_display->copyProperty(gIODisplayParametersKey));
-    if (allParams)
+    lockState();
+    ++m_doUpdateCalls;
+    if (!m_display || !m_displayParams.getParams())
     {
-        newDict = OSDictionary::withDictionary(allParams);
-        allParams->release();
+        unlockState();
+        return false;
     }
-    
-    OSDictionary* backlightParams = OSDictionary::withCapacity(2);
-    ////OSDictionary* linearParams = OSDictionary::withCapacity(2);
-
-    //REVIEW: myParams is not used...
-    OSDictionary* myParams  = OSDynamicCast(OSDictionary, copyProperty(gIODisplayParametersKey));
-    if (/*linearParams && */backlightParams && myParams)
-	{				
-		//DebugLog("%s: Level min %d, max %d, value %d\n", this->getName(), min, max, _value);
-		
-        IODisplay::addParameter(backlightParams, gIODisplayBrightnessKey, kBacklightLevelMin, kBacklightLevelMax);
-        IODisplay::setParameter(backlightParams, gIODisplayBrightnessKey, m_committed_value);
-
-        ////IODisplay::addParameter(linearParams, gIODisplayLinearBrightnessKey, 0, 0x710);
-        ////IODisplay::setParameter(linearParams, gIODisplayLinearBrightnessKey, ((_index-min) * 0x710 + (max-min)/2) / (max-min));
-
-        OSNumber* num = OSNumber::withNumber(0ULL, 32);
-        OSDictionary* commitParams = OSDictionary::withCapacity(1);
-        if (num && commitParams)
-        {
-            commitParams->setObject("reg", num);
-            backlightParams->setObject(gIODisplayParametersCommitKey, commitParams);
-            num->release();
-            commitParams->release();
-        }
-        
-        if (newDict)
-        {
-            newDict->merge(backlightParams);
-            ////newDict->merge(linearParams);
-            m_display->setProperty(gIODisplayParametersKey, newDict);
-            newDict->release();
-        }
-        else
-            m_display->setProperty(gIODisplayParametersKey, backlightParams);
-
+    OSObject* obj = m_display->copyProperty(gIODisplayParametersKey);
+    if (OSDictionary* newDict = m_displayParams.publish(OSDynamicCast(OSDictionary, obj), m_committed_value))
+    {
+        m_display->setProperty(gIODisplayParametersKey, newDict);
+        newDict->release();
         //refresh properties here too
-        setProperty(gIODisplayParametersKey, backlightParams);
-        
-        backlightParams->release();
-        myParams->release();
-        ////linearParams->release();
-
-        result = true;
-	}
-
-    IORecursiveLockUnlock(m_lock);
+        setProperty(gIODisplayParametersKey, m_displayParams.getParams());
+    }
+    OSSafeRelease(obj);
+    unlockState();
 
     //DebugLog("exit %s::%s()\n", this->getName(), __FUNCTION__);
-    return result;
+    return true;
 }
 
 
@@ -702,20 +744,29 @@ bool IntelBacklightPanel::doUpdate( void )
 void IntelBacklightPanel::setRawBrightnessLevel(UInt32 level)
 {
     //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
-    
+
+    // no tables until finishStart (handler may never attach)
+    if (!m_tables || !m_handler)
+        return;
+
+    // adjust level to within limits set by XRGL and XRGH
+    if (level > m_tables->m_scaledMax)
+        level = m_tables->m_scaledMax;
+    if (level && level < m_tables->m_scaledMin)
+        level = m_tables->m_scaledMin;
+
+    writeRawBrightnessLevel(level);
+}
+
+void IntelBacklightPanel::writeRawBrightnessLevel(UInt32 level)
+{
+    // level is expected to be already within limits
+
     if (m_handler)
     {
-        // adjust level to within limits set by XRGL and XRGH
-        if (level > m_config.m_backlightMax)
-            level = m_config.m_backlightMax;
-        if (level && level < m_config.m_backlightMin)
-            level = m_config.m_backlightMin;
-
         //set backlight via native handler
         m_handler->setBacklightLevel(level);
-        
-        // just FYI... set RawBrightness property to actual current level
-        setProperty(kRawBrightness, queryRawBrightnessLevel(), 32);
+        m_fade.m_lastRaw = level;
     }
 }
 
@@ -723,103 +774,135 @@ void IntelBacklightPanel::setBrightnessLevel(UInt32 level)
 {
     //DebugLog("%s::%s(%d)\n", this->getName(), __FUNCTION__, level);
 
-    UInt32 rem;
-    UInt32 index = indexForLevel(level, &rem);
-    UInt32 value = m_config.m_backlightLevels[index];
-    //DebugLog("%s: level=%d, index=%d, value=%d\n", this->getName(), level, index, value);
-    
-    // can set "in between" level
-    UInt32 next = index+1;
-    if (next < m_config.m_nLevels)
-    {
-        // prorate the difference...
-        UInt32 diff = m_config.m_backlightLevels[next] - value;
-        value += (diff * rem) / kBacklightLevelMax;
-        //DebugLog("%s: diff=%d, rem=%d, value=%d\n", this->getName(), diff, rem, value);
-    }
-    setRawBrightnessLevel(value);
+    if (level > kBacklightLevelMax)
+        level = kBacklightLevelMax;
+    writeRawBrightnessLevel(m_tables->m_levelToRaw[level]);
+    recordWakeLatency();
 }
 
-void IntelBacklightPanel::setBrightnessLevelSmooth(UInt32 level)
+void IntelBacklightPanel::setBrightnessLevelSmooth(UInt32 level, UInt32 duration)
 {
     //DebugLog("%s::%s(%d)\n", this->getName(), __FUNCTION__, level);
 
     //DebugLog("%s: _from_value=%d, _value=%d\n", this->getName(), _from_value, _value);
 
-    if (m_smoothTimer)
+    // only called on the work loop
+
+    // trajectory and levelToRaw are only valid up to kBacklightLevelMax
+    if (level > kBacklightLevelMax)
+        level = kBacklightLevelMax;
+    if (m_smoothTimer && !(m_tables->m_config.m_options & kDisableSmooth))
     {
-        IORecursiveLockLock(m_lock);
-        if (level != m_value)
+        if ((int)level != m_fade.m_target)
         {
-            // find appropriate movemement params in smoothData
-            int diff = abs((int)level - m_from_value);
-            m_smoothIndex = countof(smoothData)-1; // defensive
-            for (int i = 0; i < countof(smoothData); i++)
-            {
-                if (diff <= smoothData[i].delta)
-                {
-                    m_smoothIndex = i;
-                    break;
-                }
-            }
+            // new transition (or retarget) starts from current position
+            UInt64 now, length;
+            clock_get_uptime(&now);
+            // duration depends on distance, unless given
+            int diff = abs((int)level - m_fade.m_current);
+            if (!duration)
+                duration = smoothDurationForDistance(diff, m_tables->m_config.m_smoothDuration, m_tables->m_config.m_smoothDurationMin);
+            nanoseconds_to_absolutetime(MS_TO_NS(duration), &length);
+            int from = m_fade.m_current;
+            bool start = smoothFadeRetarget(&m_fade, level, now, length, smoothStepsForDuration(duration, m_tables->m_config.m_smoothInterval), m_tables->m_config.m_smoothEasing, m_tables->m_levelToRaw, !(m_tables->m_config.m_options & kLevels16Bit));
+            traceEvent(m_panelID, start ? kTraceTransition : kTraceRetarget, from, level);
             // kick off timer if not already started
-            bool start = (m_from_value == m_value);
-            m_value = level;
             if (start)
-                onSmoothTimer();
+            {
+                ++m_transitionsStarted;
+                m_transitionBegin = now;
+                m_smoothDeadline = now;
+                armSmoothTimer(now);
+            }
+            else
+                ++m_transitionsRetargeted;
         }
-        else if (m_from_value == m_value)
+        else if (!smoothFadeActive(&m_fade))
         {
             // in the case of already set to that value, set it for sure
-            setBrightnessLevel(m_value);
+            smoothFadeReset(&m_fade, m_fade.m_target, m_fade.m_lastRaw);
+            setBrightnessLevel(m_fade.m_target);
         }
-        IORecursiveLockUnlock(m_lock);
     }
     else
     {
-        m_from_value = m_value = level;
-        setBrightnessLevel(m_value);
+        smoothFadeReset(&m_fade, level, m_fade.m_lastRaw);
+        setBrightnessLevel(level);
     }
 }
 
-void IntelBacklightPanel::onSmoothTimer()
+void IntelBacklightPanel::armSmoothTimer(UInt64 now)
 {
-    //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
+    m_smoothDeadline = smoothNextDeadline(m_smoothDeadline, now, m_smoothInterval);
+    AbsoluteTime deadline;
+    AbsoluteTime_to_scalar(&deadline) = m_smoothDeadline;
+    m_smoothTimer->wakeAtTime(deadline);
+}
 
-    IORecursiveLockLock(m_lock);
+void IntelBacklightPanel::cancelSmoothTransition()
+{
+    // only called on the work loop
 
-    ////DebugLog("%s::%s(): _from_value=%d, _value=%d, _smoothIndex=%d\n", this->getName(), __FUNCTION__, _from_value, _value, _smoothIndex);
+    if (m_smoothTimer)
+        m_smoothTimer->cancelTimeout();
+    if (smoothFadeActive(&m_fade))
+        traceEvent(m_panelID, kTraceTransitionCancel, m_fade.m_current);
+    smoothFadeCancel(&m_fade);
+}
 
-    // adjust smooth index based on current delta
-    int diff = abs(m_value - m_from_value);
-    if (m_smoothIndex > 0 && diff <= smoothData[m_smoothIndex-1].delta)
-        --m_smoothIndex;
+void IntelBacklightPanel::onSmoothTimer()
+{
+    //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
 
-    // move _from_value in the direction of _value
-    SmoothData* data = &smoothData[m_smoothIndex];
-    if (m_value > m_from_value)
-        m_from_value = min(m_value, m_from_value + data->step);
+    UInt64 now, ns;
+    clock_get_uptime(&now);
+    ++m_smoothTicks;
+    if (now > m_smoothDeadline)
+    {
+        absolutetime_to_nanoseconds(now - m_smoothDeadline, &ns);
+        m_tickJitter.record(ns / 1000);
+    }
     else
-        m_from_value = max(m_value, m_from_value - data->step);
+        m_tickJitter.record(0);
 
-    // set new brigthness level
-    //DebugLog("%s::%s(): _from_value=%d, _value=%d\n", this->getName(), __FUNCTION__, _from_value, _value);
-    setBrightnessLevel(m_from_value);
-    // set new timer if not reached desired brightness previously set
-    if (m_from_value != m_value)
-        m_smoothTimer->setTimeoutUS(data->timeout);
+    // pop raw value for the step due and write it
+    UInt32 raw;
+    if (UInt32 step = smoothFadeTick(&m_fade, now, &raw))
+    {
+        traceEvent(m_panelID, kTraceTimerTick, step, raw);
+        if (kSmoothNoWrite != raw && m_handler)
+            m_handler->setBacklightLevel(raw);
+    }
 
-    IORecursiveLockUnlock(m_lock);
+    // set new timer if not reached desired brightness previously set
+    if (smoothFadeActive(&m_fade))
+        armSmoothTimer(now);
+    else
+    {
+        traceEvent(m_panelID, kTraceTransitionDone, m_fade.m_current);
+        ++m_transitionsCompleted;
+        absolutetime_to_nanoseconds(now - m_transitionBegin, &ns);
+        m_transitionDuration.record(ns / 1000);
+        recordWakeLatency();
+    }
 }
 
 void IntelBacklightPanel::savePrebootBrightnessLevel(UInt32 level)
 {
     //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
     
+    // only called on the work loop
+
     if (OSNumber* number = OSNumber::withNumber(level, 32))
     {
+        UInt64 start, end, ns;
+        clock_get_uptime(&start);
         if (kIOReturnSuccess != m_provider->evaluateObject("SAVE", NULL, (OSObject**)&number, 1))
             AlwaysLog("Error in savePrebootBrightnessLevel SAVE(%u)\n", (unsigned int)level);
+        clock_get_uptime(&end);
+        absolutetime_to_nanoseconds(end - start, &ns);
+        m_saveLatency.record(ns / 1000);
+        traceEvent(m_panelID, kTraceACPISave, level, (UInt32)(ns / 1000));
         
         //DebugLog("%s: savePrebootBrightnessLevel SAVE(%u)\n", this->getName(), (unsigned int) level);
         number->release();
@@ -830,65 +913,350 @@ void IntelBacklightPanel::saveBrightnessLevelNVRAM(UInt32 level)
 {
     //DebugLog("%s::%s(): level=%d\n", this->getName(), __FUNCTION__, level);
 
+    if (OSData* number = OSData::withBytes(&level, sizeof(level)))
+    {
+        saveNVRAMData(m_levelKey, number);
+        number->release();
+    }
+}
+
+void IntelBacklightPanel::saveNVRAMData(const char* key, OSData* data)
+{
     if (IORegistryEntry *nvram = OSDynamicCast(IORegistryEntry, fromPath("/options", gIODTPlane)))
     {
-        if (const OSSymbol* symbol = OSSymbol::withCString(kIntelBacklightLevel))
+        if (const OSSymbol* symbol = OSSymbol::withCString(key))
         {
-            if (OSData* number = OSData::withBytes(&level, sizeof(level)))
-            {
-                //DebugLog("%s: saveBrightnessLevelNVRAM got nvram %p\n", this->getName(), nvram);
-                if (!nvram->setProperty(symbol, number))
-                    DebugLog("nvram->setProperty failed\n");
-                number->release();
-            }
+            //DebugLog("%s: saveNVRAMData got nvram %p\n", this->getName(), nvram);
+            if (!nvram->setProperty(symbol, data))
+                DebugLog("nvram->setProperty(%s) failed\n", key);
             symbol->release();
         }
         nvram->release();
     }
 }
 
-UInt32 IntelBacklightPanel::loadFromNVRAM(void)
+void IntelBacklightPanel::requestSave(UInt32 level)
 {
-    //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
+    // only called on the work loop
 
-    IORegistryEntry* nvram = IORegistryEntry::fromPath("/chosen/nvram", gIODTPlane);
-    if (!nvram)
+    ++m_nvramRequested;
+    m_pendingSave = level;
+    if (level == m_persistedValue && prebootLevelForLevel(level) == m_prebootSaved)
     {
-        DebugLog("no /chosen/nvram, trying IODTNVRAM\n");
-        // probably booting w/ Clover
-        if (OSDictionary* matching = serviceMatching("IODTNVRAM"))
+        // nothing to do, but cancel any deferred write of another value
+        if (m_saveTimer)
+            m_saveTimer->cancelTimeout();
+        return;
+    }
+    // a burst of requests results in one write after things are quiet
+    if (m_saveTimer && m_tables->m_config.m_nvramSaveDelay)
+        m_saveTimer->setTimeoutMS(m_tables->m_config.m_nvramSaveDelay);
+    else
+        flushSaves();
+}
+
+UInt32 IntelBacklightPanel::prebootLevelForLevel(UInt32 level)
+{
+    // value passed to ACPI SAVE, -1 if there is nothing to save
+    if (!m_hasSaveMethod || -1 == level || !m_ready)
+        return -1;
+    return m_tables->m_scaledLevels[indexForLevel(level)];
+}
+
+void IntelBacklightPanel::flushSaves()
+{
+    // only called on the work loop (timer, command gate)
+
+    if (-1 == m_pendingSave)
+        return;
+    if (m_pendingSave != m_persistedValue)
+    {
+        traceEvent(m_panelID, kTraceNVRAMWrite, m_pendingSave);
+        saveBrightnessLevelNVRAM(m_pendingSave);
+        m_persistedValue = m_pendingSave;
+        ++m_nvramPerformed;
+    }
+    UInt32 preboot = prebootLevelForLevel(m_pendingSave);
+    if (preboot != m_prebootSaved)
+    {
+        savePrebootBrightnessLevel(preboot);
+        m_prebootSaved = preboot;
+    }
+}
+
+IOReturn IntelBacklightPanel::setPowerState(unsigned long powerState, IOService* device)
+{
+    // panel follows its power domain, on after off is a wake
+    UInt64 now;
+    clock_get_uptime(&now);
+    if (m_cmdGate)
+    {
+        if (kPowerStateOff == powerState)
+            m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &IntelBacklightPanel::prepareForSleep));
+        else
+            m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &IntelBacklightPanel::restoreAfterWake), &now);
+    }
+    return kIOPMAckImplied;
+}
+
+IOReturn IntelBacklightPanel::powerStateDidChangeTo(IOPMPowerFlags capabilities, unsigned long stateNumber, IOService* whatDevice)
+{
+    // interested driver of m_display: recheck the control registers once it
+    // is usable again after display sleep (system wake does its own resync)
+    bool usable = (capabilities & kIOPMDeviceUsable);
+    lockState();
+    bool resync = false;
+    if (whatDevice == m_display)
+    {
+        resync = usable && !m_displayUsable && m_ready;
+        m_displayUsable = usable;
+        if (resync)
         {
-            nvram = waitForMatchingService(matching, MS_TO_NS(15000));
-            matching->release();
+            ++m_displayWakeCount;
+            m_workPending |= kWorkResync;
+        }
+    }
+    unlockState();
+    if (resync)
+        m_workSource->interruptOccurred(0, 0, 0);
+    return kIOPMAckImplied;
+}
+
+void IntelBacklightPanel::prepareForSleep()
+{
+    // only called on the work loop
+
+    // a fade would be cut short anyway, stop it where it is
+    cancelSmoothTransition();
+    m_wakeStart = 0;
+    m_poweredOff = true;
+}
+
+void IntelBacklightPanel::restoreAfterWake(UInt64* wakeStart)
+{
+    // only called on the work loop
+
+    // initial power state (registerPowerDriver) is not a wake
+    if (!m_poweredOff)
+        return;
+    m_poweredOff = false;
+    if (!m_ready)
+        return;
+
+    // control registers once, instead of checking them on every set
+    m_wakeStart = *wakeStart;
+    ++m_wakeCount;
+    m_handler->resyncBacklight();
+
+    lockState();
+    int committed = m_committed_value;
+    unlockState();
+
+    // start from whatever level firmware left, latency is recorded when the
+    // committed level has been written (setBrightnessLevel or end of fade)
+    UInt32 raw = queryRawBrightnessLevel();
+    smoothFadeReset(&m_fade, levelForValue(raw), raw);
+    DebugLog("wake: firmware level %d (%d), restoring %d\n", m_fade.m_current, raw, committed);
+    UInt32 fade = m_tables->m_config.m_wakeFadeDuration;
+    if (fade && committed != m_fade.m_current)
+        setBrightnessLevelSmooth(committed, fade);
+    else
+    {
+        smoothFadeReset(&m_fade, committed, raw);
+        setBrightnessLevel(committed);
+    }
+}
+
+void IntelBacklightPanel::recordWakeLatency()
+{
+    // only called on the work loop, whenever brightness reaches its target
+    if (!m_wakeStart)
+        return;
+    UInt64 now, ns;
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now - m_wakeStart, &ns);
+    m_lastWakeLatency = ns / 1000;
+    m_wakeLatency.record(m_lastWakeLatency);
+    m_wakeStart = 0;
+}
+
+IOReturn IntelBacklightPanel::onSleepWake(void* target, void* refCon, UInt32 messageType, IOService* provider, void* messageArgument, vm_size_t argSize)
+{
+    IntelBacklightPanel* self = static_cast<IntelBacklightPanel*>(target);
+    switch (messageType)
+    {
+        case kIOMessageSystemWillSleep:
+        case kIOMessageSystemWillRestart:
+        case kIOMessageSystemWillPowerOff:
+            if (self->m_cmdGate)
+            {
+                if (self->m_saveTimer)
+                    self->m_saveTimer->cancelTimeout();
+                self->m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, self, &IntelBacklightPanel::flushSaves));
+            }
+            break;
+    }
+    return kIOReturnSuccess;
+}
+
+static UInt32 levelFromNVRAMData(OSData* data)
+{
+    UInt32 val = 0;
+    unsigned l = data->getLength();
+    if (l <= sizeof(val))
+        memcpy(&val, data->getBytesNoCopy(), l);
+    // written by an older version or something else entirely
+    if (val > kBacklightLevelMax)
+        val = kBacklightLevelMax;
+    return val;
+}
+
+bool IntelBacklightPanel::onNVRAMPublished(void* target, void* refCon, IOService* newService, IONotifier* notifier)
+{
+    IntelBacklightPanel* self = static_cast<IntelBacklightPanel*>(target);
+    if (self->m_cmdGate)
+        self->m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, self, &IntelBacklightPanel::nvramPublished), newService);
+    return true;
+}
+
+IOReturn IntelBacklightPanel::nvramPublished(IORegistryEntry* nvram)
+{
+    // only called on the work loop
+
+    if (m_nvramLoaded)
+        return kIOReturnSuccess;
+    DebugLog("have nvram from IODTNVRAM\n");
+    UInt64 now;
+    clock_get_uptime(&now);
+    m_bootTime[kBootNVRAMLocate] = now - m_startTime;
+    loadFromNVRAM(nvram);
+
+    // finishStart already ran without it: restore the saved level, unless
+    // a level has been committed since
+    if (m_ready && -1 != m_persistedValue)
+    {
+        lockState();
+        bool restore = !m_levelCommitted;
+        if (restore)
+        {
+            m_committed_value = m_value = m_saved_value = m_persistedValue;
+            DebugLog("setting to value from nvram %d\n", m_persistedValue);
+        }
+        unlockState();
+        if (restore)
+        {
+            postBrightnessLevel(m_persistedValue);
+            doUpdate();
         }
     }
-    else DebugLog("have nvram from /chosen/nvram\n");
+    publishBootTiming();
+    return kIOReturnSuccess;
+}
+
+void IntelBacklightPanel::loadFromNVRAM(IORegistryEntry* nvram)
+{
+    //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
+
+    UInt64 start, now;
+    clock_get_uptime(&start);
+
     UInt32 val = -1;
-    if (nvram)
+    OSData* compiled = NULL;
+    m_nvramReadPath = kNVRAMReadNone;
+    // fast path: ask for just the one variable (per panel key, or the
+    // single key used before panels had their own)
+    const char* const levelKeys[] = { m_levelKey, kIntelBacklightLevel };
+    for (int i = 0; i < 2 && kNVRAMReadNone == m_nvramReadPath; i++)
+    {
+        if (OSObject* obj = nvram->copyProperty(levelKeys[i]))
+        {
+            if (OSData* number = OSDynamicCast(OSData, obj))
+            {
+                val = levelFromNVRAMData(number);
+                m_nvramReadPath = kNVRAMReadDirect;
+                DebugLog("read level from nvram (direct, %s) = %d\n", levelKeys[i], val);
+            }
+            obj->release();
+        }
+    }
+    if (kNVRAMReadDirect == m_nvramReadPath)
+    {
+        OSObject* obj = nvram->copyProperty(m_configKey);
+        if (!(compiled = OSDynamicCast(OSData, obj)))
+            OSSafeRelease(obj);
+    }
+    // slow path: need to serialize as getProperty on nvram does not always work
+    if (kNVRAMReadNone == m_nvramReadPath)
     {
-        // need to serialize as getProperty on nvram does not work
         if (OSSerialize* serial = OSSerialize::withCapacity(0))
         {
             nvram->serializeProperties(serial);
             if (OSDictionary* props = OSDynamicCast(OSDictionary, OSUnserializeXML(serial->text())))
             {
-                if (OSData* number = OSDynamicCast(OSData, props->getObject(kIntelBacklightLevel)))
+                OSData* number = OSDynamicCast(OSData, props->getObject(m_levelKey));
+                if (!number)
+                    number = OSDynamicCast(OSData, props->getObject(kIntelBacklightLevel));
+                if (number)
                 {
-                    val = 0;
-                    unsigned l = number->getLength();
-                    if (l <= sizeof(val))
-                        memcpy(&val, number->getBytesNoCopy(), l);
+                    val = levelFromNVRAMData(number);
                     DebugLog("read level from nvram = %d\n", val);
-                    //number->release();
                 }
                 else DebugLog("no intel-backlight-level in nvram\n");
+                if ((compiled = OSDynamicCast(OSData, props->getObject(m_configKey))))
+                    compiled->retain();
                 props->release();
             }
             serial->release();
         }
-        nvram->release();
+        m_nvramReadPath = kNVRAMReadSerialize;
     }
-    return val;
+
+    // compiled configuration only helps if the handler has not attached yet
+    lockState();
+    m_persistedValue = val;
+    m_nvramLoaded = true;
+    if (kConfigNone == m_configPath && !m_compiledConfig)
+    {
+        m_compiledConfig = compiled;
+        compiled = NULL;
+    }
+    unlockState();
+    OSSafeRelease(compiled);
+
+    clock_get_uptime(&now);
+    m_bootTime[kBootNVRAMRead] = now - start;
+}
+
+void IntelBacklightPanel::publishBootTiming()
+{
+    static const char* const names[kBootPhaseCount] =
+    {
+        "NVRAMLocateNS", "NVRAMReadNS", "StartNS", "ConfigNS", "HandlerAttachNS", "HandlerInitNS", "ReadyNS",
+    };
+    static const char* const paths[] = { "none", "direct", "serialize" };
+    static const char* const configPaths[] = { "none", "compiled", "full" };
+
+    OSDictionary* dict = OSDictionary::withCapacity(kBootPhaseCount+2);
+    if (!dict)
+        return;
+    for (int i = 0; i < kBootPhaseCount; i++)
+    {
+        UInt64 ns;
+        absolutetime_to_nanoseconds(m_bootTime[i], &ns);
+        setDictNumber(dict, names[i], ns, 64);
+    }
+    if (OSString* path = OSString::withCString(paths[m_nvramReadPath]))
+    {
+        dict->setObject("NVRAMReadPath", path);
+        path->release();
+    }
+    if (OSString* path = OSString::withCString(configPaths[m_configPath]))
+    {
+        dict->setObject("ConfigPath", path);
+        path->release();
+    }
+    setProperty("RM,BootTiming", dict);
+    dict->release();
 }
 
 UInt32 IntelBacklightPanel::queryRawBrightnessLevel()
@@ -899,103 +1267,464 @@ UInt32 IntelBacklightPanel::queryRawBrightnessLevel()
 
 //REVIEW: maybe is really not necessary anymore...
     // adjust result to be within limits set by XRGL and XRGH
-    if (result > m_config.m_backlightMax)
-        result = m_config.m_backlightMax;
-    if (result && result < m_config.m_backlightMin)
-        result = m_config.m_backlightMin;
+    if (result > m_tables->m_scaledMax)
+        result = m_tables->m_scaledMax;
+    if (result && result < m_tables->m_scaledMin)
+        result = m_tables->m_scaledMin;
 
     return result;
 }
 
+void IntelBacklightPanel::publishRawBrightness()
+{
+    // only called on the work loop (see serializeProperties)
+    if (m_ready && m_handler)
+        setProperty(kRawBrightness, queryRawBrightnessLevel(), 32);
+}
+
+bool IntelBacklightPanel::finishTables(BacklightTables* tables, BacklightHandler2* handler)
+{
+    // validate configuration and build lookup tables for the PWM max
+    // initBacklight is expected to settle on
+
+    if (tables->m_config.m_nLevels < 2)
+    {
+        AlwaysLog("backlight handler invalid configuration (nLevels=%d)\n", tables->m_config.m_nLevels);
+        return false;
+    }
+    UInt32 pwmMax = tables->m_config.m_pwmMax;
+    if (!pwmMax)
+        pwmMax = handler->getHardwarePWMMax();
+    if (!pwmMax)
+        pwmMax = tables->m_config.m_backlightLevelsScale;
+    if (!buildLookupTables(tables, pwmMax))
+    {
+        AlwaysLog("unable to allocate lookup tables\n");
+        return false;
+    }
+    return true;
+}
+
+BacklightTables* IntelBacklightPanel::createTables(OSDictionary* config, BacklightHandler2* handler)
+{
+    // complete tables for merged configuration (config is retained by them)
+    BacklightTables* tables = new BacklightTables;
+    if (!tables)
+        return NULL;
+    config->retain();
+    tables->m_source = config;
+    if (!loadConfiguration(&tables->m_config, config) || !finishTables(tables, handler))
+    {
+        delete tables;
+        return NULL;
+    }
+    return tables;
+}
+
+void IntelBacklightPanel::installTables(BacklightTables* tables)
+{
+    // only called on the work loop; m_tables is only dereferenced there
+    // (timers, work queue, command gate, including the RawBrightness read
+    // for serializeProperties), other threads only retain m_source with
+    // m_lock held, so the tables being replaced are no longer in use once
+    // the new ones are published
+
+    // handler settles PWM max and scales the duty cycle with it
+    m_handler->initBacklight(&tables->m_config);
+    if (tables->m_config.m_pwmMax != tables->m_pwmMax)
+        buildLookupTables(tables, tables->m_config.m_pwmMax);
+
+    BacklightTables* old = m_tables;
+    lockState();
+    m_tables = tables;
+    unlockState();
+    delete old;
+
+    nanoseconds_to_absolutetime(MS_TO_NS(tables->m_config.m_smoothInterval), &m_smoothInterval);
+    setProperty(kPWMMax, tables->m_config.m_pwmMax, 32);
+}
+
+IOReturn IntelBacklightPanel::prepareReload(OSDictionary* props, BacklightTables** result)
+{
+    // runs in the caller's context: configuration is parsed and tables are
+    // built here, the work loop only has to swap them in
+
+    *result = NULL;
+    OSObject* reload = props->getObject(kReloadConfiguration);
+    OSObject* pwmMaxObj = props->getObject(kPWMMax);
+    if (!reload && !pwmMaxObj)
+        return kIOReturnSuccess;
+    OSNumber* pwmMax = OSDynamicCast(OSNumber, pwmMaxObj);
+    if (pwmMaxObj && !pwmMax)
+    {
+        AlwaysLog("%s must be a number\n", kPWMMax);
+        return kIOReturnBadArgument;
+    }
+
+    lockState();
+    BacklightHandler2* handler = m_handler;
+    OSDictionary* config = m_handlerConfig;
+    OSDictionary* source = m_tables ? m_tables->m_source : NULL;
+    if (config)
+        config->retain();
+    if (source)
+        source->retain();
+    unlockState();
+
+    // PWMMax alone keeps the current configuration (including an earlier
+    // ReloadConfiguration), otherwise it is merged again with a fresh RMCF
+    OSDictionary* merged = NULL;
+    if (reload || !source)
+    {
+        // dictionary replaces Configuration from the handler personality
+        if (OSDictionary* dict = OSDynamicCast(OSDictionary, reload))
+        {
+            dict->retain();
+            OSSafeRelease(config);
+            config = dict;
+        }
+        if (config && m_provider)
+        {
+            OSObject* rmcf = NULL;
+            if (kIOReturnSuccess != m_provider->evaluateObject("RMCF", &rmcf))
+                rmcf = NULL;
+            merged = mergeConfiguration(config, rmcf);
+            OSSafeRelease(rmcf);
+        }
+        OSSafeRelease(source);
+    }
+    else
+        merged = source;
+    OSSafeRelease(config);
+
+    if (merged && pwmMax)
+    {
+        OSDictionary* copy = OSDictionary::withDictionary(merged);
+        if (copy)
+            copy->setObject(kPWMMax, pwmMax);
+        merged->release();
+        merged = copy;
+    }
+
+    // nothing to build from is an error, a configuration that does not
+    // load (or a PWMMax it cannot use) is a bad argument
+    IOReturn ret = kIOReturnError;
+    if (merged && handler)
+    {
+        *result = createTables(merged, handler);
+        ret = *result ? kIOReturnSuccess : kIOReturnBadArgument;
+    }
+    OSSafeRelease(merged);
+    if (kIOReturnSuccess != ret)
+        AlwaysLog("configuration reload failed, keeping current configuration\n");
+    return ret;
+}
+
+void IntelBacklightPanel::reloadConfiguration(BacklightTables* tables)
+{
+    // only called on the work loop
+
+    // trajectory of a fade in progress is in units of the old tables, stop it
+    int target = m_fade.m_target;
+    cancelSmoothTransition();
+
+    installTables(tables);
+    ++m_configReloads;
+
+    // continue from current brightness (read back, now in new PWM units)
+    // to where the fade was going, along the new curve
+    UInt32 raw = queryRawBrightnessLevel();
+    smoothFadeReset(&m_fade, levelForValue(raw), raw);
+    DebugLog("configuration reloaded, PWM max %x, level %d\n", tables->m_config.m_pwmMax, m_fade.m_current);
+    setBrightnessLevelSmooth(target);
+}
+
 UInt32 IntelBacklightPanel::findIndexForLevel(UInt32 level)
 {
-	for (int i = 0; i < m_config.m_nLevels; i++)
-	{
-		if (level < m_config.m_backlightLevels[i])
-		{
-			DebugLog("findIndexForLevel(%d) is %d\n", level, i-1);
-			return i-1;
-		}
-	}
-    DebugLog("findIndexForLevel(%d) did not find\n", level);
-	return m_config.m_nLevels-1;
+    return findLevelIndex(m_tables->m_inverseLevels, m_tables->m_config.m_nLevels, level);
 }
 
 void IntelBacklightPanel::processWorkQueue(IOInterruptEventSource *, int)
 {
     //DebugLog("%s::%s() _workPending=%x\n", this->getName(), __FUNCTION__, m_workPending);
     
-    IORecursiveLockLock(m_lock);
-    if (m_workPending & kWorkSave)
-        saveBrightnessLevelNVRAM(m_committed_value);
-    if (m_workPending & kWorkSetBrightness)
-        setBrightnessLevel(m_committed_value);
+    // requests stay queued until startup has finished
+    if (!m_ready)
+        return;
+
+    // pick up latest requested brightness
+    UInt32 level;
+    do
+    {
+        level = m_mailbox;
+    } while (!OSCompareAndSwap(level, kMailboxEmpty, &m_mailbox));
+    if (kMailboxEmpty != level)
+        setBrightnessLevelSmooth(level);
+
+    lockState();
+    unsigned work = m_workPending;
+    int committed = m_committed_value;
     m_workPending = 0;
-    IORecursiveLockUnlock(m_lock);
+    unlockState();
+
+    if (work & kWorkResync)
+        m_handler->resyncBacklight();
+    if (work & kWorkSave)
+        requestSave(committed);
+    if (work & kWorkSetBrightness)
+        setBrightnessLevel(committed);
 }
 
-void IntelBacklightPanel::scheduleWork(unsigned newWork)
+void IntelBacklightPanel::postBrightnessLevel(UInt32 level)
 {
-    IORecursiveLockLock(m_lock);
-    m_workPending |= newWork;
+    // replace whatever is in the mailbox, only latest request matters
+    UInt32 old;
+    do
+    {
+        old = m_mailbox;
+    } while (!OSCompareAndSwap(old, level, &m_mailbox));
     m_workSource->interruptOccurred(0, 0, 0);
-    IORecursiveLockUnlock(m_lock);
 }
 
-IOReturn IntelBacklightPanel::setPropertiesGated(OSObject* props)
+void IntelBacklightPanel::lockState()
+{
+    UInt64 start = 0;
+    if (!IOLockTryLock(m_lock))
+    {
+        clock_get_uptime(&start);
+        IOLockLock(m_lock);
+    }
+    clock_get_uptime(&m_lockStart);
+    ++m_lockAcquired;
+    if (start)
+    {
+        UInt64 wait = m_lockStart - start;
+        ++m_lockContended;
+        m_lockWaitTime += wait;
+        if (wait > m_lockMaxWaitTime)
+            m_lockMaxWaitTime = wait;
+    }
+}
+
+void IntelBacklightPanel::unlockState()
+{
+    UInt64 now;
+    clock_get_uptime(&now);
+    UInt64 hold = now - m_lockStart;
+    m_lockHoldTime += hold;
+    if (hold > m_lockMaxHoldTime)
+        m_lockMaxHoldTime = hold;
+    IOLockUnlock(m_lock);
+}
+
+void IntelBacklightPanel::resetStats()
+{
+    // only called on the work loop (fade, NVRAM, ACPI stats are work loop only)
+
+    lockState();
+    m_lockAcquired = m_lockContended = 0;
+    m_lockWaitTime = m_lockMaxWaitTime = 0;
+    m_lockHoldTime = m_lockMaxHoldTime = 0;
+    m_integerSetLatency.reset();
+    m_doUpdateCalls = 0;
+    m_displayParams.resetStats();
+    unlockState();
+
+    m_smoothTicks = 0;
+    m_transitionsStarted = m_transitionsCompleted = m_transitionsRetargeted = 0;
+    m_transitionDuration.reset();
+    m_tickJitter.reset();
+    m_nvramRequested = m_nvramPerformed = 0;
+    m_saveLatency.reset();
+    m_configReloads = 0;
+    m_wakeCount = 0;
+    m_displayWakeCount = 0;
+    m_wakeLatency.reset();
+    if (m_handler)
+        m_handler->resetStats();
+    traceReset();
+}
+
+bool IntelBacklightPanel::serializeProperties(OSSerialize* serialize) const
+{
+    // RawBrightness is read from hardware only when someone is looking
+    // (on the work loop, tables and handler may be replaced otherwise)
+    if (m_cmdGate)
+    {
+        IntelBacklightPanel* self = const_cast<IntelBacklightPanel*>(this);
+        m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, self, &IntelBacklightPanel::publishRawBrightness));
+    }
+
+    // statistics are only gathered into dictionaries when someone is looking
+    OSDictionary* stats = OSDictionary::withCapacity(8);
+    if (!stats)
+        return super::serializeProperties(serialize);
+
+    if (OSDictionary* dict = OSDictionary::withCapacity(6))
+    {
+        UInt64 ns;
+        setDictNumber(dict, "Acquired", m_lockAcquired);
+        setDictNumber(dict, "Contended", m_lockContended);
+        absolutetime_to_nanoseconds(m_lockWaitTime, &ns);
+        setDictNumber(dict, "WaitNS", ns, 64);
+        absolutetime_to_nanoseconds(m_lockMaxWaitTime, &ns);
+        setDictNumber(dict, "MaxWaitNS", ns, 64);
+        absolutetime_to_nanoseconds(m_lockHoldTime, &ns);
+        setDictNumber(dict, "HoldNS", ns, 64);
+        absolutetime_to_nanoseconds(m_lockMaxHoldTime, &ns);
+        setDictNumber(dict, "MaxHoldNS", ns, 64);
+        stats->setObject("Lock", dict);
+        dict->release();
+    }
+    if (OSDictionary* dict = OSDictionary::withCapacity(6))
+    {
+        setDictNumber(dict, "Ticks", m_smoothTicks);
+        setDictNumber(dict, "TransitionsStarted", m_transitionsStarted);
+        setDictNumber(dict, "TransitionsCompleted", m_transitionsCompleted);
+        setDictNumber(dict, "TransitionsRetargeted", m_transitionsRetargeted);
+        m_transitionDuration.addToDictionary(dict, "TransitionDurationUS");
+        m_tickJitter.addToDictionary(dict, "TickJitterUS");
+        stats->setObject("Smooth", dict);
+        dict->release();
+    }
+    if (OSDictionary* dict = OSDictionary::withCapacity(3))
+    {
+        setDictNumber(dict, "WritesRequested", m_nvramRequested);
+        setDictNumber(dict, "WritesPerformed", m_nvramPerformed);
+        setDictNumber(dict, "PersistedValue", m_persistedValue);
+        stats->setObject("NVRAM", dict);
+        dict->release();
+    }
+    if (m_hasSaveMethod)
+    {
+        if (OSDictionary* dict = OSDictionary::withCapacity(2))
+        {
+            setDictNumber(dict, "LastLevel", m_prebootSaved);
+            m_saveLatency.addToDictionary(dict, "LatencyUS");
+            stats->setObject("ACPISave", dict);
+            dict->release();
+        }
+    }
+    if (OSDictionary* dict = OSDictionary::withCapacity(4))
+    {
+        setDictNumber(dict, "DoUpdateCalls", m_doUpdateCalls);
+        m_displayParams.addStats(dict);
+        stats->setObject("DisplayParams", dict);
+        dict->release();
+    }
+    m_integerSetLatency.addToDictionary(stats, "DoIntegerSetNS");
+    setDictNumber(stats, "ConfigReloads", m_configReloads);
+    if (OSDictionary* dict = OSDictionary::withCapacity(4))
+    {
+        setDictNumber(dict, "Count", m_wakeCount);
+        setDictNumber(dict, "DisplayCount", m_displayWakeCount);
+        setDictNumber(dict, "LastLatencyUS", m_lastWakeLatency);
+        m_wakeLatency.addToDictionary(dict, "LatencyUS");
+        stats->setObject("Wake", dict);
+        dict->release();
+    }
+    if (m_handler)
+    {
+        if (OSDictionary* dict = OSDictionary::withCapacity(8))
+        {
+            m_handler->addStats(dict);
+            stats->setObject("Handler", dict);
+            dict->release();
+        }
+    }
+    const_cast<IntelBacklightPanel*>(this)->setProperty("RM,Stats", stats);
+    stats->release();
+
+    return super::serializeProperties(serialize);
+}
+
+IOReturn IntelBacklightPanel::setPropertiesGated(OSObject* props, BacklightTables* tables)
 {
     //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
 
+    // new configuration (ReloadConfiguration, PWMMax) built by prepareReload
+    IOReturn result = kIOReturnSuccess;
+    if (tables)
+    {
+        if (m_ready)
+            reloadConfiguration(tables);
+        else
+        {
+            delete tables;
+            result = kIOReturnNotReady;
+        }
+    }
+
     OSDictionary* dict = OSDynamicCast(OSDictionary, props);
     if (!dict)
-        return kIOReturnSuccess;
+        return result;
 
-    // set brightness
+    // set brightness (start() passes the property table before the handler
+    // has attached, hardware commands wait until finishStart)
 	if (OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(kRawBrightness)))
     {
 		UInt32 raw = (int)num->unsigned32BitValue();
-        setRawBrightnessLevel(raw);
-        setProperty(kRawBrightness, queryRawBrightnessLevel(), 32);
+        if (m_ready)
+            setRawBrightnessLevel(raw);
     }
 
-#ifdef DEBUG
-    for (int i = 0; i < countof(smoothData); i++)
+    // have backlight handler reprogram PWM control registers now
+    if (dict->getObject(kResyncRegisters) && m_ready)
+        m_handler->resyncBacklight();
+
+    // start a new collection period for RM,Stats
+    if (dict->getObject(kResetStats))
+        resetStats();
+
+    // copy trace ring to RM,Trace (see trace2chrome.py)
+    if (dict->getObject(kSnapshotTrace))
     {
-        char buf[kSmoothBufSize];
-        snprintf(buf, sizeof(buf), kSmoothDelta, i);
-        if (OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(buf)))
-        {
-            smoothData[i].delta = (int)num->unsigned32BitValue();
-            setProperty(buf, smoothData[i].delta, 32);
-        }
-        snprintf(buf, sizeof(buf), kSmoothStep, i);
-        if (OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(buf)))
+        if (OSData* trace = traceSnapshot())
         {
-            smoothData[i].step = (int)num->unsigned32BitValue();
-            setProperty(buf, smoothData[i].step, 32);
-        }
-        snprintf(buf, sizeof(buf), kSmoothTimeout, i);
-        if (OSNumber* num = OSDynamicCast(OSNumber, dict->getObject(buf)))
-        {
-            smoothData[i].timeout = (int)num->unsigned32BitValue();
-            setProperty(buf, smoothData[i].timeout, 32);
+            setProperty("RM,Trace", trace);
+            trace->release();
         }
     }
-#endif
-    
-    return kIOReturnSuccess;
+
+    return result;
 }
 
 IOReturn IntelBacklightPanel::setProperties(OSObject* props)
 {
     //DebugLog("%s::%s()\n", this->getName(), __FUNCTION__);
 
+    // commands are for administrators only (sudo ioio)
+    OSDictionary* dict = OSDynamicCast(OSDictionary, props);
+    if (dict)
+    {
+        for (unsigned i = 0; i < sizeof(s_commandKeys)/sizeof(s_commandKeys[0]); i++)
+        {
+            if (!dict->getObject(s_commandKeys[i]))
+                continue;
+            if (kIOReturnSuccess != IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator))
+            {
+                AlwaysLog("%s requires administrator privilege\n", s_commandKeys[i]);
+                return kIOReturnNotPrivileged;
+            }
+            break;
+        }
+    }
+
     if (m_cmdGate)
     {
+        // new configuration is prepared before entering the gate; if it
+        // fails, the other commands still run but the request reports it
+        BacklightTables* tables = NULL;
+        IOReturn reload = kIOReturnSuccess;
+        if (dict)
+            reload = prepareReload(dict, &tables);
+
         // syncronize through workloop...
-        IOReturn result = m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &IntelBacklightPanel::setPropertiesGated), props);
+        IOReturn result = m_cmdGate->runAction(OSMemberFunctionCast(IOCommandGate::Action, this, &IntelBacklightPanel::setPropertiesGated), props, tables);
         if (kIOReturnSuccess != result)
             return result;
+        if (kIOReturnSuccess != reload)
+            return reload;
     }
     return kIOReturnSuccess;
 }
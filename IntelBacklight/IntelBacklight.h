@@ -27,14 +27,17 @@
 #include <IOKit/graphics/IODisplay.h>
 #include <IOKit/acpi/IOACPIPlatformDevice.h>
 #include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOWorkLoop.h>
 #include <IOKit/IOCommandGate.h>
 #include <IOKit/IOInterruptEventSource.h>
 #include <IOKit/IOLocks.h>
 
 #include "BacklightHandler.h"
+#include "BacklightMath.h"
+#include "DisplayParams.h"
 #include "IntelBacklightHandler.h"
-
-enum { kDisableSmooth = 0x01, kWriteLEVWOnSet = 0x02, };
+#include "SmoothTransition.h"
+#include "Stats.h"
 
 #define MS_TO_NS(ms) (1000ULL * 1000ULL * (ms))
 
@@ -52,10 +55,15 @@ class EXPORT IntelBacklightPanel : public IODisplayParameterHandler
 public:
 	// IOService
     virtual bool init();
+    virtual void free();
     virtual IOService* probe(IOService* provider, SInt32* score);
 	virtual bool start(IOService* provider);
     virtual void stop(IOService* provider);
     virtual IOReturn setProperties(OSObject* props);
+    virtual bool serializeProperties(OSSerialize* serialize) const;
+    virtual IOWorkLoop* getWorkLoop() const;
+    virtual IOReturn setPowerState(unsigned long powerState, IOService* device);
+    virtual IOReturn powerStateDidChangeTo(IOPMPowerFlags capabilities, unsigned long stateNumber, IOService* whatDevice);
 
     // IODisplayParameterHandler
     virtual bool setDisplay(IODisplay* display);
@@ -64,56 +72,161 @@ public:
     virtual bool doUpdate();
 
     // IntelBacklightPanel
-    virtual void setBacklightHandler(BacklightHandler2* handler, OSDictionary* config = NULL);
+    // returns false if a different handler is already attached
+    virtual bool setBacklightHandler(BacklightHandler2* handler, OSDictionary* config = NULL);
+    inline UInt32 getPanelID() const { return m_panelID; }
     
 private:
     BacklightHandler2* m_handler;
     IODisplay* m_display;
     IOACPIPlatformDevice* m_provider;
 
-    enum { kWorkSave = 0x01, kWorkSetBrightness = 0x02 };
+    // each panel (PNLF) is identified by its _UID, published as PanelID
+    // and used to select the handler and the NVRAM keys
+    UInt32 m_panelID;
+    char m_levelKey[32];
+    char m_configKey[32];
+
+    // own work loop, so fades on different panels run independently
+    IOWorkLoop* m_workLoop;
+
+    enum { kWorkSave = 0x01, kWorkSetBrightness = 0x02, kWorkResync = 0x04 };
     IOInterruptEventSource* m_workSource;
     unsigned m_workPending;
-    PRIVATE void scheduleWork(unsigned newWork);
     
     IOTimerEventSource* m_smoothTimer;
     IOCommandGate* m_cmdGate;
-    int m_smoothIndex;
-
-    static IORecursiveLock* m_lock;
-    friend kern_return_t IntelBacklight_Start(kmod_info_t*, void*);
-    friend kern_return_t IntelBacklight_Stop(kmod_info_t*, void*);
 
+    // current transition (absolute time units, work loop only)
+    SmoothFade m_fade;
+    UInt64 m_smoothDeadline;
+    UInt64 m_smoothInterval;
+
+    // fade statistics (work loop only)
+    UInt32 m_smoothTicks;
+    UInt32 m_transitionsStarted, m_transitionsCompleted, m_transitionsRetargeted;
+    UInt64 m_transitionBegin;
+    Log2Histogram m_transitionDuration; // us
+    Log2Histogram m_tickJitter;         // us past deadline
+
+    // m_lock protects state shared with callers (m_value, m_committed_value,
+    // m_saved_value, m_workPending); fade state is only touched on the work loop
+    IOLock* m_lock;
+    PRIVATE void lockState();
+    PRIVATE void unlockState();
+    UInt64 m_lockStart;
+    UInt32 m_lockAcquired, m_lockContended;
+    UInt64 m_lockWaitTime, m_lockMaxWaitTime;
+    UInt64 m_lockHoldTime, m_lockMaxHoldTime;
+    Log2Histogram m_integerSetLatency;  // ns, recorded with m_lock held
+
+    // latest requested brightness, consumed on the work loop
+    volatile UInt32 m_mailbox;
+    PRIVATE void postBrightnessLevel(UInt32 level);
+
+    // set once finishStart has initialized the handler and lookup tables
+    bool m_ready;
+    PRIVATE IOReturn finishStart(BacklightTables* tables);
+
+    // brightness parameters (m_lock held), doUpdate publishes new ones
+    // merged into the display's current parameters when the display does not
+    // show the committed value
+    DisplayParams m_displayParams;
+    UInt32 m_doUpdateCalls;
+
+    // ACPI SAVE is evaluated on the work loop with the NVRAM write
     bool m_hasSaveMethod;
+    UInt32 m_prebootSaved;
+    Log2Histogram m_saveLatency;    // us
     PRIVATE void savePrebootBrightnessLevel(UInt32 level);
+    PRIVATE UInt32 prebootLevelForLevel(UInt32 level);
     
 	PRIVATE void setRawBrightnessLevel(UInt32 level);
+    PRIVATE void writeRawBrightnessLevel(UInt32 level);
 	PRIVATE UInt32 queryRawBrightnessLevel();
+    PRIVATE void publishRawBrightness();
     PRIVATE void setBrightnessLevel(UInt32 level);
-    PRIVATE void setBrightnessLevelSmooth(UInt32 level);
+    PRIVATE void setBrightnessLevelSmooth(UInt32 level, UInt32 duration = 0);
 	PRIVATE UInt32 findIndexForLevel(UInt32 BCLvalue);
-    
-    BacklightConfig m_config;
+
+    // current tables, replaced as a whole on the work loop (pointer also
+    // stored with m_lock held, so m_source can be retained from any thread)
+    BacklightTables* m_tables;
+    OSDictionary* m_handlerConfig;  // Configuration from handler personality
+    UInt32 m_configReloads;
+    PRIVATE BacklightTables* createTables(OSDictionary* config, BacklightHandler2* handler);
+    PRIVATE bool finishTables(BacklightTables* tables, BacklightHandler2* handler);
+    PRIVATE void installTables(BacklightTables* tables);
+    PRIVATE IOReturn prepareReload(OSDictionary* props, BacklightTables** tables);
+    PRIVATE void reloadConfiguration(BacklightTables* tables);
 
     int m_value;  // osx value
-    int m_from_value; // current value working towards _value
     int m_committed_value;
     int m_saved_value;
     
     PRIVATE void processWorkQueue(IOInterruptEventSource*, int);
     PRIVATE void onSmoothTimer();
+    PRIVATE void armSmoothTimer(UInt64 now);
+    PRIVATE void cancelSmoothTransition();
     PRIVATE void saveBrightnessLevelNVRAM(UInt32 level);
-    PRIVATE UInt32 loadFromNVRAM();
+
+    // NVRAM/ACPI persistence, debounced and skipped when unchanged (work loop only)
+    IOTimerEventSource* m_saveTimer;
+    IONotifier* m_sleepWakeNotifier;
+    UInt32 m_persistedValue;
+    UInt32 m_pendingSave;
+    UInt32 m_nvramRequested, m_nvramPerformed;
+    PRIVATE void requestSave(UInt32 level);
+    PRIVATE void flushSaves();
+    static IOReturn onSleepWake(void* target, void* refCon, UInt32 messageType, IOService* provider, void* messageArgument, vm_size_t argSize);
+
+    // IODTNVRAM may be published after start (probably booting w/ Clover),
+    // the saved level is then read on the work loop when it appears
+    IONotifier* m_nvramNotifier;
+    bool m_nvramLoaded;
+    bool m_levelCommitted;      // brightness committed since startup finished
+    PRIVATE void loadFromNVRAM(IORegistryEntry* nvram);
+    PRIVATE IOReturn nvramPublished(IORegistryEntry* nvram);
+    static bool onNVRAMPublished(void* target, void* refCon, IOService* newService, IONotifier* notifier);
+
+    // power managed driver: wake reprograms PWM control registers once and
+    // restores the committed level (work loop only); display wake (without
+    // system sleep) only reprograms the registers
+    bool m_poweredOff;
+    UInt64 m_wakeStart;         // setPowerState on, 0 once level is restored
+    UInt32 m_wakeCount;
+    bool m_displayUsable;       // interested driver of m_display (display sleep)
+    UInt32 m_displayWakeCount;
+    UInt32 m_lastWakeLatency;   // us
+    Log2Histogram m_wakeLatency; // us, setPowerState on to level restored
+    PRIVATE void prepareForSleep();
+    PRIVATE void restoreAfterWake(UInt64* wakeStart);
+    PRIVATE void recordWakeLatency();
+
+    // boot path timing (absolute time units), published as RM,BootTiming
+    // StartNS, HandlerAttachNS and ReadyNS are measured from entry to start()
+    enum { kBootNVRAMLocate, kBootNVRAMRead, kBootStart, kBootConfig, kBootHandlerAttach, kBootHandlerInit, kBootReady, kBootPhaseCount };
+    enum { kNVRAMReadNone, kNVRAMReadDirect, kNVRAMReadSerialize };
+    UInt64 m_startTime;
+    UInt64 m_bootTime[kBootPhaseCount];
+    UInt32 m_nvramReadPath;
+    PRIVATE void publishBootTiming();
+
+    // loadConfiguration result from a previous boot (see CompiledConfig.h)
+    enum { kConfigNone, kConfigCompiled, kConfigFull };
+    OSData* m_compiledConfig;
+    bool m_compiledConfigDirty;
+    UInt32 m_configPath;
+    PRIVATE void saveNVRAMData(const char* key, OSData* data);
+
     PRIVATE NOINLINE UInt32 indexForLevel(UInt32 value, UInt32* rem = NULL);
     PRIVATE NOINLINE UInt32 levelForIndex(UInt32 level);
     PRIVATE UInt32 levelForValue(UInt32 value);
 
-    PRIVATE IOReturn setPropertiesGated(OSObject* props);
-    PRIVATE bool loadConfiguration(OSDictionary* config);
+    PRIVATE IOReturn setPropertiesGated(OSObject* props, BacklightTables* tables = NULL);
+    PRIVATE void resetStats();
 
-    PRIVATE OSDictionary* getConfigurationOverride(const char* method);
-    PRIVATE OSObject* translateArray(OSArray* array);
-    PRIVATE OSObject* translateEntry(OSObject* obj);
+    PRIVATE OSDictionary* mergeConfiguration(OSDictionary* config, OSObject* rmcf);
 };
 
 #endif // _INTELBACKLIGHT_H
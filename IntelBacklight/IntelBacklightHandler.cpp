@@ -27,18 +27,6 @@
 
 OSDefineMetaClassAndStructors(IntelBacklightHandler2, BacklightHandler2)
 
-// macros for backlight register access
-#define REG32_READ(offset)          (*(volatile UInt32*)((UInt8*)m_baseAddr+(offset)))
-#define REG32_WRITE(offset,value)   ((*(volatile UInt32*)((UInt8*)m_baseAddr+(offset))) = (value))
-
-// register offsets, refer to Intel reference for details
-#define LEV2 0x48250
-#define LEVL 0x48254
-#define P0BL 0x70040
-#define LEVW 0xc8250
-#define LEVX 0xc8254
-#define PCHL 0xe1180
-
 bool IntelBacklightHandler2::init()
 {
     if (!super::init())
@@ -46,9 +34,10 @@ bool IntelBacklightHandler2::init()
 
     m_provider = NULL;
     m_baseMap = NULL;
-    m_baseAddr = NULL;
+    m_pwm = NULL;
     m_panel = NULL;
     m_fbtype = 0;
+    m_panelNotifier = NULL;
 
     return true;
 }
@@ -72,18 +61,12 @@ IOService* IntelBacklightHandler2::probe(IOService* provider, SInt32* score)
         AlwaysLog("unable to map BAR1... aborting\n");
         return NULL;
     }
-    m_baseAddr = reinterpret_cast<volatile void *>(m_baseMap->getVirtualAddress());
-    if (!m_baseAddr)
+    volatile void* baseAddr = reinterpret_cast<volatile void *>(m_baseMap->getVirtualAddress());
+    if (!baseAddr)
     {
         AlwaysLog("unable to get virtual address for BAR1... aborting\n");
         return NULL;
     }
-    // save copy of registers at startup
-    m_lev2 = REG32_READ(LEV2);
-    m_levl = REG32_READ(LEVL);
-    m_levw = REG32_READ(LEVW);
-    m_levx = REG32_READ(LEVX);
-    m_pchl = REG32_READ(PCHL);
 
     OSNumber* num = OSDynamicCast(OSNumber, getProperty("kFrameBufferType"));
     if (!num)
@@ -93,6 +76,44 @@ IOService* IntelBacklightHandler2::probe(IOService* provider, SInt32* score)
     }
     m_fbtype = num->unsigned32BitValue();
 
+    const RegisterLayout* layout = findRegisterLayout(m_fbtype);
+    if (!layout)
+    {
+        AlwaysLog("framebuffer type %d not supported\n", m_fbtype);
+        return NULL;
+    }
+
+    // PWM controller on the PCH, selected by Controller in the personality
+    // (Ivy/Sandy through Skylake have a single controller)
+    UInt32 controller = 0;
+    if (OSNumber* number = OSDynamicCast(OSNumber, getProperty("Controller")))
+        controller = number->unsigned32BitValue();
+    if (controller >= layout->m_controllers)
+    {
+        AlwaysLog("backlight controller %d not supported\n", controller);
+        return NULL;
+    }
+
+    // all register access goes through counting wrapper over MMIO
+    MMIORegisterAccess* mmio = new MMIORegisterAccess(baseAddr);
+    if (!mmio)
+        return NULL;
+    CountingRegisterAccess* regs = new CountingRegisterAccess(mmio);
+    if (!regs)
+    {
+        delete mmio;
+        return NULL;
+    }
+    DebugOnly(regs->setTrace(getProperty("TraceRegisters") == kOSBooleanTrue));
+
+    // saves PWM setup from firmware
+    m_pwm = new PWMController(regs, layout, controller);
+    if (!m_pwm)
+    {
+        delete regs;
+        return NULL;
+    }
+
     return this;
 }
 
@@ -101,28 +122,29 @@ bool IntelBacklightHandler2::start(IOService* provider)
     if (!super::start(provider))
         return false;
 
-    //REVIEW: 15 second wait here... probably more than needed...
+    // attach to IntelBacklightPanel whenever it is published (may be already)
     // the "pilot error" case here is that the person did not patch for PNLF
-
-    // setup for direct access
-    IOService* service = waitForMatchingService(serviceMatching("IntelBacklightPanel"));
-    if (!service)
+    // with PanelID in the personality, only the panel with that _UID matches
+    OSDictionary* matching = serviceMatching("IntelBacklightPanel");
+    OSObject* panelID = getProperty("PanelID");
+    if (matching && panelID)
     {
-        AlwaysLog("IntelBacklightPanel not found (PNLF patch missing?)... aborting\n");
-        return false;
+        const OSSymbol* key = OSSymbol::withCString("PanelID");
+        if (!key || !propertyMatching(key, panelID, matching))
+            OSSafeReleaseNULL(matching);
+        OSSafeRelease(key);
     }
-    m_panel = OSDynamicCast(IntelBacklightPanel, service);
-    if (!m_panel)
+    if (matching)
     {
-        AlwaysLog("Backlight service was not IntelBacklightPanel\n");
-        service->release();
+        m_panelNotifier = addMatchingNotification(gIOFirstPublishNotification, matching, &IntelBacklightHandler2::onPanelPublished, this);
+        matching->release();
+    }
+    if (!m_panelNotifier)
+    {
+        AlwaysLog("unable to install IntelBacklightPanel notification... aborting\n");
         return false;
     }
 
-    // now register with IntelBacklight
-    m_panel->setBacklightHandler(this, OSDynamicCast(OSDictionary, getProperty("Configuration")));
-
-    // register service so IntelBacklightPanel can proceed...
     registerService();
 
     return true;
@@ -130,172 +152,108 @@ bool IntelBacklightHandler2::start(IOService* provider)
 
 void IntelBacklightHandler2::stop(IOService* provider)
 {
+    if (m_panelNotifier)
+    {
+        m_panelNotifier->remove();
+        m_panelNotifier = NULL;
+    }
     if (m_panel)
     {
         m_panel->setBacklightHandler(NULL);
         m_panel->release();
         m_panel = NULL;
     }
+    if (m_pwm)
+    {
+        delete m_pwm;
+        m_pwm = NULL;
+    }
     OSSafeReleaseNULL(m_baseMap);
-    m_baseAddr = NULL;
     m_provider = NULL;
     m_config = NULL;
 
     super::stop(provider);
 }
 
-void IntelBacklightHandler2::initBacklight(BacklightConfig* config)
+bool IntelBacklightHandler2::onPanelPublished(void* target, void* refCon, IOService* newService, IONotifier* notifier)
 {
-    if (!m_baseAddr)
-        return;
+    IntelBacklightHandler2* self = static_cast<IntelBacklightHandler2*>(target);
+    if (self->m_panel)
+        return true;
 
-    m_config = config;
+    IntelBacklightPanel* panel = OSDynamicCast(IntelBacklightPanel, newService);
+    if (!panel)
+    {
+        AlwaysLog("Backlight service was not IntelBacklightPanel\n");
+        return true;
+    }
+    panel->retain();
+    self->m_panel = panel;
+    self->m_pwm->getRegisters()->setPanelID(panel->getPanelID());
 
-    switch (m_fbtype)
+    // now register with IntelBacklight (finishes its startup)
+    if (!panel->setBacklightHandler(self, OSDynamicCast(OSDictionary, self->getProperty("Configuration"))))
     {
-        case kFBTypeIvySandy:
-        {
-            // gather current settings from PWM hardware
-            if (!m_config->m_pchlInit)
-                m_config->m_pchlInit = m_pchl;
-            if (!m_config->m_pwmMax)
-                m_config->m_pwmMax = m_levx>>16;
-            if (!m_config->m_pwmMax)
-                m_config->m_pwmMax = m_config->m_backlightLevelsScale;
-
-            // adjust settings of PWM hardware depending on configuration
-            UInt16 pwmMax = REG32_READ(LEVX)>>16;
-            if (pwmMax != m_config->m_pwmMax)
-            {
-                UInt32 newLevel = REG32_READ(LEVL);
-                if (!pwmMax || !newLevel)
-                    newLevel = pwmMax = m_config->m_pwmMax;
-                newLevel *= m_config->m_pwmMax;
-                newLevel /= pwmMax;
-                //REVIEW: wait for vblank before setting new PWM config
-                ////for (UInt32 p0bl = REG32_READ(P0BL); REG32_READ(P0BL) == p0bl; );
-                if (REG32_READ(LEVL) > m_config->m_pwmMax)
-                {
-                    REG32_WRITE(LEVX, m_config->m_pwmMax<<16);
-                    REG32_WRITE(LEVL, newLevel);
-                }
-                else
-                {
-                    REG32_WRITE(LEVL, newLevel);
-                    REG32_WRITE(LEVX, m_config->m_pwmMax<<16);
-                }
-            }
-            break;
-        }
-
-        case kFBTypeHaswellBroadwell:
-        {
-            // Default value for m_pchlInit is 0xC0000000...
-            // This 0xC value comes from looking what OS X initializes this
-            // register to after display sleep (using ACPIDebug/ACPIPoller)
-            if (m_config->m_levwInit)
-                REG32_WRITE(LEVW, m_config->m_levwInit);
-            if (!m_config->m_pwmMax)
-                m_config->m_pwmMax = m_levx>>16;
-            if (!m_config->m_pwmMax)
-                m_config->m_pwmMax = m_config->m_backlightLevelsScale;
-            // adjust settings of PWM hardware depending on configuration
-            UInt16 pwmMax = REG32_READ(LEVX)>>16;
-            if (pwmMax != m_config->m_pwmMax)
-            {
-                DebugLog("pwmMax!=config.pwmMax, adjusting: pwmMax=%x, config.pwmMax=%x, m_levx=%x\n", pwmMax, config->m_pwmMax, m_levx>>16);
-                UInt32 newLevel = REG32_READ(LEVX) & 0xFFFF;
-                if (!pwmMax || !newLevel)
-                    newLevel = pwmMax = m_config->m_pwmMax;
-                newLevel *= m_config->m_pwmMax;
-                newLevel /= pwmMax;
-                //REVIEW: wait for vblank before setting new PWM config
-                ////for (UInt32 p0bl = REG32_READ(P0BL); REG32_READ(P0BL) == p0bl; );
-                REG32_WRITE(LEVX, (m_config->m_pwmMax<<16) | newLevel);
-            }
-            break;
-        }
+        // bound to another handler, wait for next panel
+        self->m_panel = NULL;
+        panel->release();
     }
 
-    // scale levels if needed
-    if (m_config->m_pwmMax != m_config->m_backlightLevelsScale)
+    return true;
+}
+
+bool IntelBacklightHandler2::serializeProperties(OSSerialize* serialize) const
+{
+    // publish register traffic counters only when someone is looking
+    if (OSDictionary* dict = OSDictionary::withCapacity(8))
     {
-        UInt32 newLevel;
-        for (int i = 0; i < m_config->m_nLevels; i++)
-        {
-            newLevel = m_config->m_backlightLevels[i];
-            newLevel *= m_config->m_pwmMax;
-            newLevel /= m_config->m_backlightLevelsScale;
-            m_config->m_backlightLevels[i] = newLevel;
-        }
-        // scale backightMin
-        newLevel = m_config->m_backlightMin;
-        newLevel *= m_config->m_pwmMax;
-        newLevel /= m_config->m_backlightLevelsScale;
-        m_config->m_backlightMin = newLevel;
-        // scale backlight Max
-        newLevel = m_config->m_backlightMax;
-        newLevel *= m_config->m_pwmMax;
-        newLevel /= m_config->m_backlightLevelsScale;
-        m_config->m_backlightMax = newLevel;
+        const_cast<IntelBacklightHandler2*>(this)->addStats(dict);
+        const_cast<IntelBacklightHandler2*>(this)->setProperty("RegisterTraffic", dict);
+        dict->release();
     }
+    return super::serializeProperties(serialize);
 }
 
-void IntelBacklightHandler2::setBacklightLevel(UInt32 level)
+void IntelBacklightHandler2::addStats(OSDictionary* dict)
 {
-    if (!m_baseAddr || !m_config)
+    if (m_pwm)
+        m_pwm->addStats(dict);
+}
+
+void IntelBacklightHandler2::resetStats()
+{
+    if (m_pwm)
+        m_pwm->resetStats();
+}
+
+void IntelBacklightHandler2::initBacklight(BacklightConfig* config)
+{
+    if (!m_pwm)
         return;
 
-    // write backlight level
-    switch (m_fbtype)
-    {
-        case kFBTypeHaswellBroadwell:
-        {
-            if ((m_config->m_options & kWriteLEVWOnSet) && m_config->m_levwInit)
-                REG32_WRITE(LEVW, m_config->m_levwInit);
-            // store new backlight level and restore max
-            REG32_WRITE(LEVX, (m_config->m_pwmMax<<16) | level);
-            break;
-        }
-
-        case kFBTypeIvySandy:
-        {
-            // initialize for consistent backlight level before/after sleep\n
-            if (m_config->m_pchlInit != -1 && REG32_READ(PCHL) != m_config->m_pchlInit)
-                REG32_WRITE(PCHL, m_config->m_pchlInit);
-            if (REG32_READ(LEVW) != 0x80000000)
-                REG32_WRITE(LEVW, 0x80000000);
-            if (REG32_READ(LEVX) != m_config->m_pwmMax<<16)
-                REG32_WRITE(LEVX, m_config->m_pwmMax<<16);
-            // store new backlight level
-            if (REG32_READ(LEV2) != 0x80000000)
-                REG32_WRITE(LEV2, 0x80000000);
-            REG32_WRITE(LEVL, level);
-            break;
-        }
-    }
+    m_config = config;
+    m_pwm->initBacklight(config);
 }
 
-UInt32 IntelBacklightHandler2::getBacklightLevel()
+void IntelBacklightHandler2::setBacklightLevel(UInt32 level)
 {
-    if (!m_baseAddr || !m_config)
-        return -1;
+    if (m_pwm)
+        m_pwm->setBacklightLevel(level);
+}
 
-    // read backlight level
-    UInt32 result = -1;
-    switch (m_fbtype)
-    {
-        case kFBTypeHaswellBroadwell:
-        {
-            result = REG32_READ(LEVX) & 0xFFFF;
-            break;
-        }
-
-        case kFBTypeIvySandy:
-        {
-            result = REG32_READ(LEVL);
-            break;
-        }
-    }
-    return result;
+void IntelBacklightHandler2::resyncBacklight()
+{
+    if (m_pwm)
+        m_pwm->resyncBacklight();
+}
+
+UInt32 IntelBacklightHandler2::getHardwarePWMMax()
+{
+    // PWM max as left by firmware (saved at probe)
+    return m_pwm ? m_pwm->getHardwarePWMMax() : 0;
+}
+
+UInt32 IntelBacklightHandler2::getBacklightLevel()
+{
+    return m_pwm ? m_pwm->getBacklightLevel() : -1;
 }
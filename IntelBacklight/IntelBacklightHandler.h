@@ -27,6 +27,7 @@
 
 #include "Common.h"
 #include "BacklightHandler.h"
+#include "PWMController.h"
 
 class IntelBacklightPanel;
 
@@ -38,27 +39,28 @@ class EXPORT IntelBacklightHandler2 : public BacklightHandler2
 private:
     IOPCIDevice* m_provider;
     IOMemoryMap* m_baseMap;
-    volatile void* m_baseAddr;
+    PWMController* m_pwm;
     IntelBacklightPanel* m_panel;
+    IONotifier* m_panelNotifier;
+    static bool onPanelPublished(void* target, void* refCon, IOService* newService, IONotifier* notifier);
     UInt32 m_fbtype;
 
-    // saved register values from startup...
-    //REVIEW: do we need all of these?
-    UInt32 m_lev2, m_levl, m_levw, m_levx, m_pchl;
-
-    enum { kFBTypeIvySandy = 1, kFBTypeHaswellBroadwell = 2, };
-
 public:
     // IOService
     virtual bool init();
     virtual IOService* probe(IOService* provider, SInt32* score);
     virtual bool start(IOService* provider);
     virtual void stop(IOService* provider);
+    virtual bool serializeProperties(OSSerialize* serialize) const;
 
     // BacklightHandler
     virtual void initBacklight(BacklightConfig* config);
     virtual void setBacklightLevel(UInt32 level);
     virtual UInt32 getBacklightLevel();
+    virtual void resyncBacklight();
+    virtual UInt32 getHardwarePWMMax();
+    virtual void addStats(OSDictionary* dict);
+    virtual void resetStats();
 };
 
 
@@ -0,0 +1,194 @@
+//
+//  PWMController.cpp
+//
+
+#include "Debug.h"
+#include "Common.h"
+#include "PWMController.h"
+#include "BacklightMath.h"
+
+PWMController::PWMController(CountingRegisterAccess* regs, const RegisterLayout* layout, UInt32 controller)
+{
+    m_regs = regs;
+    m_layout = layout;
+    m_pchOffset = controller * 0x100;
+    m_config = NULL;
+    m_initReads = m_initWrites = 0;
+    m_setReads = m_setWrites = 0;
+    m_resyncCount = 0;
+    m_resyncReads = m_resyncWrites = 0;
+
+    // save PWM setup from firmware
+    m_hardwarePWMMax = readPWMMax();
+    m_pchl = 0;
+    if (m_layout->m_flags & kLayoutValidateControl)
+        m_pchl = m_regs->read32(PCHL);
+}
+
+PWMController::~PWMController()
+{
+    delete m_regs;
+}
+
+void PWMController::addStats(OSDictionary* dict)
+{
+    setDictNumber(dict, "InitReads", m_initReads);
+    setDictNumber(dict, "InitWrites", m_initWrites);
+    setDictNumber(dict, "SetReads", m_setReads);
+    setDictNumber(dict, "SetWrites", m_setWrites);
+    setDictNumber(dict, "TotalReads", m_regs->getReads());
+    setDictNumber(dict, "TotalWrites", m_regs->getWrites());
+    setDictNumber(dict, "ResyncReads", m_resyncReads);
+    setDictNumber(dict, "ResyncWrites", m_resyncWrites);
+    setDictNumber(dict, "Resyncs", m_resyncCount);
+}
+
+void PWMController::resetStats()
+{
+    // per-operation counts (Init*, Set*, Resync*) describe the last operation and are kept
+    m_regs->resetCounts();
+    m_resyncCount = 0;
+}
+
+void PWMController::initBacklight(BacklightConfig* config)
+{
+    m_config = config;
+    UInt32 reads = m_regs->getReads(), writes = m_regs->getWrites();
+
+    // gather current settings from PWM hardware
+    if (m_layout->m_flags & kLayoutValidateControl)
+    {
+        if (!m_config->m_pchlInit)
+            m_config->m_pchlInit = m_pchl;
+    }
+    else if (m_config->m_levwInit)
+    {
+        // Default value for m_levwInit is 0xC0000000 on Haswell/Broadwell...
+        // This 0xC value comes from looking what OS X initializes this
+        // register to after display sleep (using ACPIDebug/ACPIPoller)
+        m_regs->write32(m_layout->m_ctl + m_pchOffset, m_config->m_levwInit);
+    }
+    if (!m_config->m_pwmMax)
+        m_config->m_pwmMax = m_hardwarePWMMax;
+    if (!m_config->m_pwmMax)
+        m_config->m_pwmMax = m_config->m_backlightLevelsScale;
+    // only 16 bits available if PWM max shares its register with duty cycle
+    if ((m_layout->m_freqShift || (m_config->m_options & kLevels16Bit)) && m_config->m_pwmMax > 0xFFFF)
+        m_config->m_pwmMax = 0xFFFF;
+
+    // adjust settings of PWM hardware depending on configuration
+    // (levels are scaled to PWM max by the panel, source table is not touched)
+    if (readPWMMax() != m_config->m_pwmMax)
+        programPWMMax(m_config->m_pwmMax);
+    if (m_layout->m_flags & kLayoutValidateControl)
+        programControlRegisters();
+
+    m_initReads = m_regs->getReads() - reads;
+    m_initWrites = m_regs->getWrites() - writes;
+    DebugLog("initBacklight register traffic: reads=%d, writes=%d\n", m_initReads, m_initWrites);
+}
+
+void PWMController::setBacklightLevel(UInt32 level)
+{
+    if (!m_config)
+        return;
+
+    UInt32 reads = m_regs->getReads(), writes = m_regs->getWrites();
+
+    if (!(m_layout->m_flags & kLayoutValidateControl) && (m_config->m_options & kWriteLEVWOnSet) && m_config->m_levwInit)
+        m_regs->write32(m_layout->m_ctl + m_pchOffset, m_config->m_levwInit);
+
+    // store new backlight level (restoring max if it shares the register)
+    if (m_layout->m_freq == m_layout->m_duty)
+        m_regs->write32(m_layout->m_duty + m_pchOffset, (m_config->m_pwmMax<<16) | level);
+    else
+        m_regs->write32(m_layout->m_duty + m_pchOffset, level);
+
+    m_setReads = m_regs->getReads() - reads;
+    m_setWrites = m_regs->getWrites() - writes;
+}
+
+void PWMController::programControlRegisters()
+{
+    // initialize for consistent backlight level before/after sleep
+    if (m_config->m_pchlInit != -1 && m_regs->read32(PCHL) != m_config->m_pchlInit)
+        m_regs->write32(PCHL, m_config->m_pchlInit);
+    if (m_regs->read32(m_layout->m_ctl) != 0x80000000)
+        m_regs->write32(m_layout->m_ctl, 0x80000000);
+    if (m_regs->read32(m_layout->m_freq) != m_config->m_pwmMax<<16)
+        m_regs->write32(m_layout->m_freq, m_config->m_pwmMax<<16);
+    if (m_regs->read32(LEV2) != 0x80000000)
+        m_regs->write32(LEV2, 0x80000000);
+}
+
+void PWMController::resyncBacklight()
+{
+    // firmware may have reset the PWM control registers (wake), program them
+    // once from configuration; the panel restores the level right after
+    if (!m_config)
+        return;
+
+    UInt32 reads = m_regs->getReads(), writes = m_regs->getWrites();
+
+    if (m_layout->m_flags & kLayoutValidateControl)
+        programControlRegisters();
+    else
+    {
+        if (m_config->m_levwInit)
+            m_regs->write32(m_layout->m_ctl + m_pchOffset, m_config->m_levwInit);
+        if (readPWMMax() != m_config->m_pwmMax)
+            programPWMMax(m_config->m_pwmMax);
+    }
+
+    m_resyncReads = m_regs->getReads() - reads;
+    m_resyncWrites = m_regs->getWrites() - writes;
+    ++m_resyncCount;
+}
+
+void PWMController::programPWMMax(UInt32 newMax)
+{
+    // duty cycle is scaled along with PWM max, so brightness stays the same
+    UInt32 pwmMax = readPWMMax();
+    UInt32 duty = readDutyCycle();
+    UInt32 newLevel = duty;
+    DebugLog("programPWMMax: pwmMax=%x, newMax=%x, duty=%x\n", pwmMax, newMax, duty);
+    if (!pwmMax || !newLevel)
+        newLevel = pwmMax = newMax;
+    newLevel = scaleLevel(newLevel, newMax, pwmMax, !(m_config->m_options & kLevels16Bit));
+    //REVIEW: wait for vblank before setting new PWM config
+    ////for (UInt32 p0bl = m_regs->read32(P0BL); m_regs->read32(P0BL) == p0bl; );
+    if (m_layout->m_freq == m_layout->m_duty)
+        m_regs->write32(m_layout->m_freq + m_pchOffset, (newMax<<16) | newLevel);
+    else if (newMax > pwmMax)
+    {
+        // duty cycle never exceeds PWM max in between the two writes
+        m_regs->write32(m_layout->m_freq + m_pchOffset, newMax<<m_layout->m_freqShift);
+        m_regs->write32(m_layout->m_duty + m_pchOffset, newLevel);
+    }
+    else
+    {
+        m_regs->write32(m_layout->m_duty + m_pchOffset, newLevel);
+        m_regs->write32(m_layout->m_freq + m_pchOffset, newMax<<m_layout->m_freqShift);
+    }
+}
+
+UInt32 PWMController::readPWMMax()
+{
+    UInt32 value = m_regs->read32(m_layout->m_freq + m_pchOffset);
+    return m_layout->m_freqShift ? value >> m_layout->m_freqShift : value;
+}
+
+UInt32 PWMController::readDutyCycle()
+{
+    UInt32 value = m_regs->read32(m_layout->m_duty + m_pchOffset);
+    return m_layout->m_freq == m_layout->m_duty ? value & 0xFFFF : value;
+}
+
+UInt32 PWMController::getBacklightLevel()
+{
+    if (!m_config)
+        return -1;
+
+    // read backlight level
+    return readDutyCycle();
+}
@@ -0,0 +1,66 @@
+//
+//  PWMController.h
+//
+
+#ifndef _PWM_CONTROLLER_H
+#define _PWM_CONTROLLER_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSDictionary.h>
+
+#include "Configuration.h"
+#include "RegisterAccess.h"
+
+// Programming of one PCH PWM controller for IntelBacklightHandler2: what is
+// written for init/set/resync and the register traffic each one caused.  No
+// IOKit, so the host tool runs it against SimulatedRegisterAccess.
+
+class PWMController
+{
+private:
+    CountingRegisterAccess* m_regs;
+    const RegisterLayout* m_layout;
+    UInt32 m_pchOffset;     // second controller is at +0x100 on parts that have one
+    BacklightConfig* m_config;
+
+    // saved register values from startup...
+    UInt32 m_hardwarePWMMax, m_pchl;
+
+    // register traffic for last initBacklight/setBacklightLevel, as the
+    // difference of the totals (these calls come from the panel work loop)
+    UInt32 m_initReads, m_initWrites;
+    UInt32 m_setReads, m_setWrites;
+
+    // Ivy/Sandy control registers (PCHL, LEVW, LEVX, LEV2) are programmed by
+    // initBacklight and again by resyncBacklight (panel wake), not on every set
+    UInt32 m_resyncCount;
+    UInt32 m_resyncReads, m_resyncWrites;
+
+    UInt32 readPWMMax();
+    UInt32 readDutyCycle();
+    void programPWMMax(UInt32 pwmMax);
+    void programControlRegisters();
+
+public:
+    // takes ownership of regs, reads PWM setup left by firmware
+    PWMController(CountingRegisterAccess* regs, const RegisterLayout* layout, UInt32 controller);
+    ~PWMController();
+
+    void initBacklight(BacklightConfig* config);
+    void setBacklightLevel(UInt32 level);
+    UInt32 getBacklightLevel();
+    void resyncBacklight();
+    inline UInt32 getHardwarePWMMax() { return m_hardwarePWMMax; }
+
+    inline CountingRegisterAccess* getRegisters() { return m_regs; }
+    inline UInt32 getInitReads() { return m_initReads; }
+    inline UInt32 getInitWrites() { return m_initWrites; }
+    inline UInt32 getSetReads() { return m_setReads; }
+    inline UInt32 getSetWrites() { return m_setWrites; }
+    inline UInt32 getResyncReads() { return m_resyncReads; }
+    inline UInt32 getResyncWrites() { return m_resyncWrites; }
+    void addStats(OSDictionary* dict);
+    void resetStats();
+};
+
+#endif // _PWM_CONTROLLER_H
@@ -0,0 +1,175 @@
+//
+//  RegisterAccess.cpp
+//
+
+#include <libkern/OSAtomic.h>
+
+#include "Debug.h"
+#include "Common.h"
+#include "RegisterAccess.h"
+#include "Trace.h"
+
+#define kPWMEnable 0x80000000
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark Register layouts
+#pragma mark -
+
+static const RegisterLayout s_layouts[] =
+{
+    // fbtype                   ctl   freq  shift duty  ctls  flags
+    { kFBTypeIvySandy,          LEVW, LEVX, 16,   LEVL, 1,    kLayoutValidateControl },
+    { kFBTypeHaswellBroadwell,  LEVW, LEVX, 16,   LEVX, 1,    0 },
+    { kFBTypeCannonPoint,       LEVW, LEVX, 0,    LEVD, 2,    0 },
+};
+
+const RegisterLayout* findRegisterLayout(UInt32 fbtype)
+{
+    for (unsigned i = 0; i < sizeof(s_layouts)/sizeof(s_layouts[0]); i++)
+    {
+        if (s_layouts[i].m_fbtype == fbtype)
+            return &s_layouts[i];
+    }
+    return NULL;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark MMIORegisterAccess
+#pragma mark -
+
+UInt32 MMIORegisterAccess::read32(UInt32 offset)
+{
+    return *(volatile UInt32*)(m_baseAddr+offset);
+}
+
+void MMIORegisterAccess::write32(UInt32 offset, UInt32 value)
+{
+    *(volatile UInt32*)(m_baseAddr+offset) = value;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark SimulatedRegisterAccess
+#pragma mark -
+
+SimulatedRegisterAccess::SimulatedRegisterAccess(UInt32 fbtype, UInt32 pwmMax, UInt32 level)
+{
+    // state as firmware would typically leave it
+    m_fbtype = fbtype;
+    m_pchl = 0;
+    m_p0bl = 0;
+    m_levw = kPWMEnable;
+    m_lev2 = kPWMEnable;
+    m_levd = 0;
+    switch (m_fbtype)
+    {
+        case kFBTypeIvySandy:
+            m_levl = level & 0xFFFF;
+            m_levx = pwmMax<<16;
+            break;
+
+        case kFBTypeCannonPoint:
+            m_levl = 0;
+            m_levx = pwmMax;
+            m_levd = level;
+            break;
+
+        default:
+            m_levl = 0;
+            m_levx = (pwmMax<<16) | (level & 0xFFFF);
+            break;
+    }
+}
+
+UInt32 SimulatedRegisterAccess::read32(UInt32 offset)
+{
+    switch (offset)
+    {
+        case LEV2: return m_lev2;
+        case LEVL: return m_levl;
+        case LEVW: return m_levw;
+        case LEVX: return m_levx;
+        case LEVD: return m_levd;
+        case PCHL: return m_pchl;
+        // frame counter advances on every read (one frame per read)
+        case P0BL: return ++m_p0bl;
+    }
+    return 0;
+}
+
+void SimulatedRegisterAccess::write32(UInt32 offset, UInt32 value)
+{
+    switch (offset)
+    {
+        case LEV2: m_lev2 = value; break;
+        case LEVW: m_levw = value; break;
+        case PCHL: m_pchl = value; break;
+        case LEVL:
+            // duty cycle for CPU PWM is low 16 bits
+            m_levl = value & 0xFFFF;
+            break;
+        case LEVX:
+            // on Ivy/Sandy only PWM max (high 16 bits) is implemented in LEVX
+            // on Haswell/Broadwell low 16 bits are duty cycle
+            // on Cannon Point and later it is all PWM max
+            if (kFBTypeIvySandy == m_fbtype)
+                m_levx = value & 0xFFFF0000;
+            else
+                m_levx = value;
+            break;
+        case LEVD: m_levd = value; break;
+        // P0BL is read-only
+    }
+}
+
+UInt32 SimulatedRegisterAccess::getDutyCycle()
+{
+    switch (m_fbtype)
+    {
+        case kFBTypeIvySandy:
+            if (!(m_lev2 & kPWMEnable))
+                return 0;
+            return m_levl;
+
+        case kFBTypeHaswellBroadwell:
+            if (!(m_levw & kPWMEnable))
+                return 0;
+            return m_levx & 0xFFFF;
+
+        case kFBTypeCannonPoint:
+            if (!(m_levw & kPWMEnable))
+                return 0;
+            return m_levd;
+    }
+    return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark CountingRegisterAccess
+#pragma mark -
+
+CountingRegisterAccess::~CountingRegisterAccess()
+{
+    delete m_backend;
+}
+
+UInt32 CountingRegisterAccess::read32(UInt32 offset)
+{
+    OSIncrementAtomic(&m_reads);
+    UInt32 value = m_backend->read32(offset);
+    if (m_trace)
+        DebugLog("read32(%x) = %x\n", offset, value);
+    return value;
+}
+
+void CountingRegisterAccess::write32(UInt32 offset, UInt32 value)
+{
+    OSIncrementAtomic(&m_writes);
+    traceEvent(m_panelID, kTraceRegisterWrite, offset, value);
+    if (m_trace)
+        DebugLog("write32(%x, %x)\n", offset, value);
+    m_backend->write32(offset, value);
+}
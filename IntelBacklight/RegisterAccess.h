@@ -0,0 +1,111 @@
+//
+//  RegisterAccess.h
+//
+
+#ifndef _REGISTER_ACCESS_H
+#define _REGISTER_ACCESS_H
+
+#include <libkern/OSTypes.h>
+#include "Common.h"
+
+// register offsets, refer to Intel reference for details
+#define LEV2 0x48250
+#define LEVL 0x48254
+#define P0BL 0x70040
+#define LEVW 0xc8250
+#define LEVX 0xc8254
+#define LEVD 0xc8258
+#define PCHL 0xe1180
+
+// framebuffer types (kFrameBufferType in Info.plist)
+enum { kFBTypeIvySandy = 1, kFBTypeHaswellBroadwell = 2, kFBTypeCannonPoint = 3, };
+
+// Where each generation keeps its PWM state, selected at probe by
+// kFrameBufferType.  If m_freq and m_duty are the same register, PWM max is
+// in the high 16 bits and duty cycle in the low 16 bits.  Registers of a
+// second PCH controller are at +0x100 (only on Cannon Point and later, the
+// Lynx Point/Sunrise Point PCH of Haswell through Skylake has just one).
+enum
+{
+    kLayoutValidateControl = 0x01,  // PCHL, LEVW, LEVX, LEV2 reprogrammed at init and resync (wake,
+                                    // display change), not on each set (Ivy/Sandy)
+};
+
+struct RegisterLayout
+{
+    UInt32 m_fbtype;
+    UInt32 m_ctl;           // PWM enable (bit 31)
+    UInt32 m_freq;          // PWM max
+    UInt32 m_freqShift;     // position of PWM max in m_freq
+    UInt32 m_duty;          // duty cycle
+    UInt32 m_controllers;
+    UInt32 m_flags;
+};
+
+const RegisterLayout* findRegisterLayout(UInt32 fbtype);
+
+// Backend for 32-bit register access.  IntelBacklightHandler2 does all of
+// its register traffic through one of these, so the backend can be swapped
+// for a simulated register file or wrapped for counting/tracing.
+
+class RegisterAccess
+{
+public:
+    virtual ~RegisterAccess() {}
+    virtual UInt32 read32(UInt32 offset) = 0;
+    virtual void write32(UInt32 offset, UInt32 value) = 0;
+};
+
+// real hardware, memory mapped through BAR1
+class MMIORegisterAccess : public RegisterAccess
+{
+private:
+    volatile UInt8* m_baseAddr;
+
+public:
+    MMIORegisterAccess(volatile void* baseAddr) : m_baseAddr((volatile UInt8*)baseAddr) {}
+    virtual UInt32 read32(UInt32 offset);
+    virtual void write32(UInt32 offset, UInt32 value);
+};
+
+// in-memory model of the PWM registers, for host builds
+class SimulatedRegisterAccess : public RegisterAccess
+{
+private:
+    UInt32 m_fbtype;
+    UInt32 m_lev2, m_levl, m_levw, m_levx, m_levd, m_pchl, m_p0bl;
+
+public:
+    SimulatedRegisterAccess(UInt32 fbtype, UInt32 pwmMax, UInt32 level);
+    virtual UInt32 read32(UInt32 offset);
+    virtual void write32(UInt32 offset, UInt32 value);
+
+    // current duty cycle as the panel would see it
+    UInt32 getDutyCycle();
+};
+
+// wraps another backend, counting (and optionally logging) each access
+// (counts are atomic, the handler is used from probe/start and panel work loop)
+class CountingRegisterAccess : public RegisterAccess
+{
+private:
+    RegisterAccess* m_backend;
+    volatile SInt32 m_reads, m_writes;
+    bool m_trace;
+    UInt32 m_panelID;
+
+public:
+    CountingRegisterAccess(RegisterAccess* backend) : m_backend(backend), m_reads(0), m_writes(0), m_trace(false), m_panelID(0) {}
+    virtual ~CountingRegisterAccess();
+    virtual UInt32 read32(UInt32 offset);
+    virtual void write32(UInt32 offset, UInt32 value);
+
+    inline UInt32 getReads() { return (UInt32)m_reads; }
+    inline UInt32 getWrites() { return (UInt32)m_writes; }
+    inline void resetCounts() { m_reads = m_writes = 0; }
+    inline void setTrace(bool trace) { m_trace = trace; }
+    // panel the writes are traced for
+    inline void setPanelID(UInt32 panelID) { m_panelID = panelID; }
+};
+
+#endif // _REGISTER_ACCESS_H
@@ -0,0 +1,101 @@
+//
+//  SmoothTransition.cpp
+//
+
+#include "BacklightMath.h"
+#include "SmoothTransition.h"
+
+UInt32 smoothDurationForDistance(UInt32 distance, UInt32 duration, UInt32 durationMin)
+{
+    UInt32 result = duration * distance / kBacklightLevelMax;
+    if (result < durationMin)
+        result = durationMin;
+    return result;
+}
+
+UInt32 smoothStepsForDuration(UInt32 durationMS, UInt32 intervalMS)
+{
+    UInt32 steps = (durationMS + intervalMS - 1) / intervalMS;
+    if (steps < 1)
+        steps = 1;
+    if (steps > kSmoothMaxSteps)
+        steps = kSmoothMaxSteps;
+    return steps;
+}
+
+void buildSmoothTrajectory(SmoothTrajectory* trajectory, UInt32 from, int to, UInt32 steps, UInt32 easing, const UInt32* levelToRaw, bool interpolate)
+{
+    if (steps < 1)
+        steps = 1;
+    if (steps > kSmoothMaxSteps)
+        steps = kSmoothMaxSteps;
+
+    SInt64 delta = ((SInt64)to << 16) - from;
+    for (UInt32 i = 0; i < steps; i++)
+    {
+        UInt32 t = ((i+1) << 16) / steps;
+        UInt32 position = from + (SInt32)((delta * easePosition(easing, t)) >> 16);
+        trajectory->m_positions[i] = position;
+        trajectory->m_raw[i] = interpolate ? rawForFixedLevel(levelToRaw, position) : levelToRaw[(position + kFixedOne/2) >> 16];
+    }
+    trajectory->m_steps = steps;
+}
+
+UInt32 smoothStepDue(UInt64 elapsed, UInt64 duration, UInt32 steps)
+{
+    if (elapsed >= duration)
+        return steps;
+    return (UInt32)(elapsed * steps / duration);
+}
+
+UInt64 smoothNextDeadline(UInt64 deadline, UInt64 now, UInt64 interval)
+{
+    deadline += interval;
+    if (deadline <= now)
+        deadline = now + interval;
+    return deadline;
+}
+
+void smoothFadeReset(SmoothFade* fade, int level, UInt32 raw)
+{
+    fade->m_current = fade->m_target = level;
+    fade->m_position = level << 16;
+    fade->m_lastRaw = raw;
+    fade->m_start = fade->m_duration = 0;
+    fade->m_step = fade->m_trajectory.m_steps = 0;
+}
+
+void smoothFadeCancel(SmoothFade* fade)
+{
+    fade->m_target = fade->m_current;
+    fade->m_step = fade->m_trajectory.m_steps;
+}
+
+bool smoothFadeRetarget(SmoothFade* fade, int level, UInt64 now, UInt64 duration, UInt32 steps, UInt32 easing, const UInt32* levelToRaw, bool interpolate)
+{
+    bool start = !smoothFadeActive(fade);
+    // whole path (or remaining path, if retargeting) computed once
+    fade->m_start = now;
+    fade->m_duration = duration;
+    buildSmoothTrajectory(&fade->m_trajectory, fade->m_position, level, steps, easing, levelToRaw, interpolate);
+    fade->m_step = 0;
+    fade->m_target = level;
+    return start;
+}
+
+UInt32 smoothFadeTick(SmoothFade* fade, UInt64 now, UInt32* raw)
+{
+    // step due is purely a function of time elapsed since transition start
+    *raw = kSmoothNoWrite;
+    UInt32 step = smoothStepDue(now - fade->m_start, fade->m_duration, fade->m_trajectory.m_steps);
+    if (step)
+    {
+        fade->m_step = step;
+        fade->m_position = fade->m_trajectory.m_positions[step-1];
+        fade->m_current = (fade->m_position + kFixedOne/2) >> 16;
+        UInt32 value = fade->m_trajectory.m_raw[step-1];
+        if (value != fade->m_lastRaw)
+            *raw = fade->m_lastRaw = value;
+    }
+    return step;
+}
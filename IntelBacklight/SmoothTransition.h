@@ -0,0 +1,79 @@
+//
+//  SmoothTransition.h
+//
+
+#ifndef _SMOOTH_TRANSITION_H
+#define _SMOOTH_TRANSITION_H
+
+#include <libkern/OSTypes.h>
+
+// Pieces of the smooth transition logic in IntelBacklightPanel that do not
+// depend on the clock or on IOKit, so the host simulator (host/) runs exactly
+// the same steps.  Like BacklightMath, only libkern/OSTypes.h is needed.
+
+#define kSmoothMaxSteps 128
+
+// position (16.16 OS X level) and raw value for each step of a transition
+// (entry i is step i+1)
+struct SmoothTrajectory
+{
+    UInt32 m_steps;
+    UInt32 m_positions[kSmoothMaxSteps];
+    UInt32 m_raw[kSmoothMaxSteps];
+};
+
+// ms for a transition across distance OS X levels
+UInt32 smoothDurationForDistance(UInt32 distance, UInt32 duration, UInt32 durationMin);
+
+// timer ticks needed for durationMS, at least one
+UInt32 smoothStepsForDuration(UInt32 durationMS, UInt32 intervalMS);
+
+// whole path computed once from a 16.16 position, last step is exactly the
+// target; with interpolate, raw values fall between OS X levels
+void buildSmoothTrajectory(SmoothTrajectory* trajectory, UInt32 from, int to, UInt32 steps, UInt32 easing, const UInt32* levelToRaw, bool interpolate);
+
+// step due at elapsed time into a transition of duration (any time unit)
+UInt32 smoothStepDue(UInt64 elapsed, UInt64 duration, UInt32 steps);
+
+// next tick is one interval after previous deadline, regardless of when the
+// timer actually fired... if that is already past (timer was late), skip
+// ahead as position is computed from elapsed time
+UInt64 smoothNextDeadline(UInt64 deadline, UInt64 now, UInt64 interval);
+
+// a transition as setBrightnessLevelSmooth/onSmoothTimer run it, shared with
+// the host simulator; times are in whatever unit the caller's clock uses
+struct SmoothFade
+{
+    int m_current;          // level reached so far (m_position rounded)
+    UInt32 m_position;      // 16.16 position of the step taken
+    int m_target;           // level the fade is working towards
+    UInt32 m_lastRaw;       // raw value last written to the panel
+    UInt32 m_step;          // last step of m_trajectory taken
+    UInt64 m_start;
+    UInt64 m_duration;
+    SmoothTrajectory m_trajectory;
+};
+
+#define kSmoothNoWrite 0xFFFFFFFF
+
+// at rest at level, raw is what the panel is known to show
+void smoothFadeReset(SmoothFade* fade, int level, UInt32 raw);
+
+// stops where it is (m_current)
+void smoothFadeCancel(SmoothFade* fade);
+
+// until the last step, rounded levels may already show the target while raw
+// values (interpolated) do not
+inline bool smoothFadeActive(const SmoothFade* fade) { return fade->m_step < fade->m_trajectory.m_steps; }
+
+// (re)target the fade at level, from the exact position it has reached (not
+// the rounded level), so raw values carry on from the one last written;
+// m_lastRaw is kept, so a retarget never repeats a write the panel already
+// has... true if the fade was at rest (caller arms its timer)
+bool smoothFadeRetarget(SmoothFade* fade, int level, UInt64 now, UInt64 duration, UInt32 steps, UInt32 easing, const UInt32* levelToRaw, bool interpolate);
+
+// step due at now (0 if none yet), *raw is the value to write or
+// kSmoothNoWrite if the panel already shows it
+UInt32 smoothFadeTick(SmoothFade* fade, UInt64 now, UInt32* raw);
+
+#endif // _SMOOTH_TRANSITION_H
@@ -0,0 +1,57 @@
+//
+//  Stats.cpp
+//
+
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSNumber.h>
+
+#include "Common.h"
+#include "Stats.h"
+
+void Log2Histogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_max = 0;
+    m_total = 0;
+}
+
+void Log2Histogram::record(UInt64 value)
+{
+    unsigned bucket = 0;
+    for (UInt64 v = value; v && bucket < kBuckets-1; v >>= 1)
+        ++bucket;
+    ++m_buckets[bucket];
+    ++m_count;
+    m_total += value;
+    if (value > m_max)
+        m_max = value;
+}
+
+void Log2Histogram::addToDictionary(OSDictionary* dict, const char* key) const
+{
+    OSDictionary* hist = OSDictionary::withCapacity(4);
+    OSArray* buckets = OSArray::withCapacity(kBuckets);
+    if (hist && buckets)
+    {
+        // trailing empty buckets are left out
+        int last = kBuckets-1;
+        while (last >= 0 && !m_buckets[last])
+            --last;
+        for (int i = 0; i <= last; i++)
+        {
+            if (OSNumber* num = OSNumber::withNumber(m_buckets[i], 32))
+            {
+                buckets->setObject(num);
+                num->release();
+            }
+        }
+        setDictNumber(hist, "Count", m_count);
+        setDictNumber(hist, "Max", m_max, 64);
+        setDictNumber(hist, "Total", m_total, 64);
+        hist->setObject("Buckets", buckets);
+        dict->setObject(key, hist);
+    }
+    OSSafeRelease(buckets);
+    OSSafeRelease(hist);
+}
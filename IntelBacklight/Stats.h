@@ -0,0 +1,35 @@
+//
+//  Stats.h
+//
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSDictionary.h>
+
+// Counts values by power of two: bucket 0 holds 0, bucket i holds values
+// in [2^(i-1), 2^i), last bucket holds everything larger.  Recording is a
+// few instructions and never allocates; dictionaries are only built when
+// the registry is read.
+
+class Log2Histogram
+{
+public:
+    enum { kBuckets = 24 };
+
+    void reset();
+    void record(UInt64 value);
+    inline UInt32 getCount() const { return m_count; }
+
+    // adds dictionary with Count, Max, Total and Buckets under key
+    void addToDictionary(OSDictionary* dict, const char* key) const;
+
+private:
+    UInt32 m_buckets[kBuckets];
+    UInt32 m_count;
+    UInt64 m_max;
+    UInt64 m_total;
+};
+
+#endif // _STATS_H
@@ -0,0 +1,99 @@
+//
+//  Trace.cpp
+//
+
+#include <libkern/OSAtomic.h>
+#include <kern/clock.h>
+
+#include "Common.h"
+#include "Trace.h"
+
+#define kTraceRecords   1024    // must be power of 2
+#define kTraceRetries   3       // snapshot retries for a slot being written
+
+static TraceRecord g_traceRing[kTraceRecords];
+static volatile SInt32 g_traceNext;
+// sequence number of the first record after the last reset
+static volatile SInt32 g_traceFirst;
+
+void traceEvent(UInt32 panel, UInt32 event, UInt32 arg1, UInt32 arg2)
+{
+    UInt32 seq = (UInt32)OSIncrementAtomic(&g_traceNext);
+    volatile TraceRecord* record = &g_traceRing[seq & (kTraceRecords-1)];
+    // mark slot as being written before touching the payload
+    record->m_seq = 0;
+    OSMemoryBarrier();
+    UInt64 time;
+    clock_get_uptime(&time);
+    record->m_time = time;
+    record->m_panel = panel;
+    record->m_event = event;
+    record->m_arg1 = arg1;
+    record->m_arg2 = arg2;
+    record->m_reserved = 0;
+    OSMemoryBarrier();
+    record->m_seq = seq + 1;
+}
+
+void traceReset()
+{
+    // recording may be in progress, so the ring is left alone, only the
+    // records before this point are no longer part of a snapshot
+    g_traceFirst = g_traceNext;
+}
+
+static bool traceCopyRecord(UInt32 seq, TraceRecord* out)
+{
+    volatile TraceRecord* record = &g_traceRing[seq & (kTraceRecords-1)];
+    for (int retry = 0; retry < kTraceRetries; retry++)
+    {
+        UInt32 begin = record->m_seq;
+        OSMemoryBarrier();
+        out->m_time = record->m_time;
+        out->m_panel = record->m_panel;
+        out->m_event = record->m_event;
+        out->m_arg1 = record->m_arg1;
+        out->m_arg2 = record->m_arg2;
+        out->m_reserved = 0;
+        OSMemoryBarrier();
+        if (record->m_seq != begin)
+            continue;
+        // 0 while being written, newer sequence if already reused
+        out->m_seq = begin;
+        return begin == seq + 1;
+    }
+    return false;
+}
+
+OSData* traceSnapshot()
+{
+    UInt32 reset = (UInt32)g_traceFirst;
+    UInt32 next = (UInt32)g_traceNext;
+    UInt32 first = next - reset > kTraceRecords ? next - kTraceRecords : reset;
+
+    TraceHeader header;
+    header.m_magic = kTraceMagic;
+    header.m_version = kTraceVersion;
+    header.m_count = 0;
+    header.m_lost = first - reset;
+    OSData* data = OSData::withCapacity(sizeof(header) + (next - first) * sizeof(TraceRecord));
+    if (!data || !data->appendBytes(&header, sizeof(header)))
+    {
+        OSSafeRelease(data);
+        return NULL;
+    }
+    for (UInt32 seq = first; seq != next; seq++)
+    {
+        // skip slots being written or already reused by newer events
+        TraceRecord record;
+        if (!traceCopyRecord(seq, &record))
+            continue;
+        absolutetime_to_nanoseconds(record.m_time, &record.m_time);
+        if (!data->appendBytes(&record, sizeof(record)))
+            break;
+        ++header.m_count;
+    }
+    // count is only known now
+    memcpy((UInt8*)data->getBytesNoCopy(), &header, sizeof(header));
+    return data;
+}
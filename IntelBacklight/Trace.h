@@ -0,0 +1,60 @@
+//
+//  Trace.h
+//
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSData.h>
+
+// Fixed size ring of timestamped events, shared by all panels and handlers.
+// Recording claims a slot with one atomic increment and fills it in, so it
+// is cheap enough to leave enabled in Release builds.  Each slot is guarded
+// by its sequence number (a per-record seqlock), so a snapshot taken while
+// events are recorded skips records being written instead of copying them
+// torn.  A snapshot (see SnapshotTrace in README) is converted to Chrome
+// trace JSON on the host by trace2chrome.py.
+
+enum
+{
+    kTraceSetRequest = 1,   // arg1 = requested OS X level
+    kTraceCommit,           // arg1 = committed OS X level
+    kTraceTransition,       // arg1 = from level, arg2 = to level (start)
+    kTraceTimerTick,        // arg1 = step, arg2 = raw value (-1 if unchanged)
+    kTraceTransitionDone,   // arg1 = level
+    kTraceRegisterWrite,    // arg1 = register offset, arg2 = value
+    kTraceNVRAMWrite,       // arg1 = OS X level
+    kTraceACPISave,         // arg1 = raw level, arg2 = latency us
+    kTraceRetarget,         // arg1 = from level, arg2 = new target level
+    kTraceTransitionCancel, // arg1 = level (sleep or configuration reload)
+};
+
+#define kTraceMagic     0x52544249  // 'IBTR'
+#define kTraceVersion   2
+
+// snapshot layout: TraceHeader followed by m_count TraceRecord, oldest first
+struct TraceHeader
+{
+    UInt32 m_magic;
+    UInt32 m_version;
+    UInt32 m_count;
+    UInt32 m_lost;          // records overwritten since the last reset
+};
+
+struct TraceRecord
+{
+    UInt64 m_time;          // ring: absolute time, snapshot: nanoseconds
+    UInt32 m_seq;           // sequence number + 1, 0 while being written
+    UInt32 m_panel;         // PanelID (_UID) of the panel the event is for
+    UInt32 m_event;
+    UInt32 m_arg1;
+    UInt32 m_arg2;
+    UInt32 m_reserved;      // keeps records 8 byte aligned
+};
+
+void traceEvent(UInt32 panel, UInt32 event, UInt32 arg1 = 0, UInt32 arg2 = 0);
+void traceReset();
+OSData* traceSnapshot();
+
+#endif // _TRACE_H
@@ -0,0 +1,180 @@
+//
+//  Baseline.cpp
+//
+
+#include <libkern/c++/OSNumber.h>
+
+#include "BacklightMath.h"
+#include "Baseline.h"
+
+#define kRawBrightness "RawBrightness"
+
+BaselinePanel::BaselinePanel(const BacklightConfig& config, UInt32 pwmMax)
+{
+    m_nLevels = config.m_nLevels;
+    m_levels = new UInt32[m_nLevels];
+    for (UInt32 i = 0; i < m_nLevels; i++)
+        m_levels[i] = config.m_backlightLevels[i];
+    m_backlightMin = config.m_backlightMin;
+    m_backlightMax = config.m_backlightMax;
+
+    // scale levels if needed
+    if (pwmMax != config.m_backlightLevelsScale)
+    {
+        UInt32 newLevel;
+        for (UInt32 i = 0; i < m_nLevels; i++)
+        {
+            newLevel = m_levels[i];
+            newLevel *= pwmMax;
+            newLevel /= config.m_backlightLevelsScale;
+            m_levels[i] = newLevel;
+        }
+        // scale backightMin
+        newLevel = m_backlightMin;
+        newLevel *= pwmMax;
+        newLevel /= config.m_backlightLevelsScale;
+        m_backlightMin = newLevel;
+        // scale backlight Max
+        newLevel = m_backlightMax;
+        newLevel *= pwmMax;
+        newLevel /= config.m_backlightLevelsScale;
+        m_backlightMax = newLevel;
+    }
+}
+
+BaselinePanel::~BaselinePanel()
+{
+    delete[] m_levels;
+}
+
+#define m_max   (m_nLevels-1)
+#define m_min   (0)
+
+UInt32 BaselinePanel::indexForLevel(UInt32 value, UInt32* rem)
+{
+    UInt32 index = value * (m_max-m_min);
+    if (rem)
+        *rem = index % kBacklightLevelMax;
+    index = index / kBacklightLevelMax + m_min;
+    return index;
+}
+
+UInt32 BaselinePanel::rawForLevel(UInt32 level)
+{
+    UInt32 rem;
+    UInt32 index = indexForLevel(level, &rem);
+    UInt32 value = m_levels[index];
+
+    // can set "in between" level
+    UInt32 next = index+1;
+    if (next < m_nLevels)
+    {
+        // prorate the difference...
+        UInt32 diff = m_levels[next] - value;
+        value += (diff * rem) / kBacklightLevelMax;
+    }
+
+    // adjust level to within limits set by XRGL and XRGH
+    if (value > m_backlightMax)
+        value = m_backlightMax;
+    if (value && value < m_backlightMin)
+        value = m_backlightMin;
+    return value;
+}
+
+UInt32 BaselinePanel::findIndexForLevel(UInt32 raw)
+{
+    for (UInt32 i = 0; i < m_nLevels; i++)
+    {
+        if (raw < m_levels[i])
+            return i-1;
+    }
+    return m_nLevels-1;
+}
+
+UInt32 BaselinePanel::levelForIndex(UInt32 index)
+{
+    // not really possible, but quiets the static analyzer...
+    if (m_max-m_min <= 0) return 0;
+    return ((index-m_min) * kBacklightLevelMax + (m_max-m_min)/2) / (m_max-m_min);
+}
+
+UInt32 BaselinePanel::levelForValue(UInt32 raw)
+{
+    UInt32 index = findIndexForLevel(raw);
+    UInt32 level = levelForIndex(index);
+    if (index < m_max)
+    {
+        // pro-rate between levels
+        int diff = levelForIndex(index+1) - level;
+        if (m_levels[index+1] != m_levels[index])
+        {
+            diff *= raw - m_levels[index];
+            diff /= m_levels[index+1] - m_levels[index];
+            level += diff;
+        }
+    }
+    return level;
+}
+
+#undef m_max
+#undef m_min
+
+BaselineFade::BaselineFade(PWMController* pwm, const BacklightTables* tables)
+{
+    m_pwm = pwm;
+    m_properties = OSDictionary::withCapacity(1);
+    m_levelToRaw = tables->m_levelToRaw;
+    m_easing = tables->m_config.m_smoothEasing;
+    m_backlightMin = tables->m_scaledMin;
+    m_backlightMax = tables->m_scaledMax;
+    m_smoothFrom = m_from_value = m_value = 0;
+    m_smoothStart = m_smoothDuration = 0;
+}
+
+BaselineFade::~BaselineFade()
+{
+    m_properties->release();
+}
+
+void BaselineFade::start(int from, int to, UInt64 now, UInt64 duration)
+{
+    m_smoothStart = now;
+    m_smoothDuration = duration;
+    m_smoothFrom = m_from_value = from;
+    m_value = to;
+}
+
+bool BaselineFade::tick(UInt64 now)
+{
+    // position is purely a function of time elapsed since transition start
+    UInt64 elapsed = now - m_smoothStart;
+    if (elapsed >= m_smoothDuration)
+        m_from_value = m_value;
+    else
+    {
+        UInt32 t = (UInt32)((elapsed << 16) / m_smoothDuration);
+        int delta = m_value - m_smoothFrom;
+        m_from_value = m_smoothFrom + (int)(((SInt64)delta * easePosition(m_easing, t) + kFixedOne/2) >> 16);
+    }
+
+    // setBrightnessLevel
+    UInt32 level = m_from_value;
+    if (level > kBacklightLevelMax)
+        level = kBacklightLevelMax;
+    m_pwm->setBacklightLevel(m_levelToRaw[level]);
+
+    // just FYI... set RawBrightness property to actual current level
+    UInt32 result = m_pwm->getBacklightLevel();
+    if (result > m_backlightMax)
+        result = m_backlightMax;
+    if (result && result < m_backlightMin)
+        result = m_backlightMin;
+    if (OSNumber* num = OSNumber::withNumber(result, 32))
+    {
+        m_properties->setObject(kRawBrightness, num);
+        num->release();
+    }
+
+    return m_from_value != m_value;
+}
@@ -0,0 +1,72 @@
+//
+//  Baseline.h
+//
+
+#ifndef _BASELINE_H
+#define _BASELINE_H
+
+#include <libkern/OSTypes.h>
+
+#include <libkern/c++/OSDictionary.h>
+
+#include "Configuration.h"
+#include "PWMController.h"
+
+// Copies of the kext's level math as it was before the lookup tables, and of
+// the fade timer before the trajectory buffer, so the tests can check the new
+// code is bit-exact against it (16-bit mode) and the benchmarks can compare
+// before and after.
+
+struct BaselinePanel
+{
+    // levels, min and max rescaled to PWM max in place, as initBacklight did
+    UInt32* m_levels;
+    UInt32 m_nLevels;
+    UInt32 m_backlightMin, m_backlightMax;
+
+    BaselinePanel(const BacklightConfig& config, UInt32 pwmMax);
+    ~BaselinePanel();
+
+    // IntelBacklightPanel::indexForLevel
+    UInt32 indexForLevel(UInt32 value, UInt32* rem);
+
+    // IntelBacklightPanel::setBrightnessLevel and the clamps of
+    // setRawBrightnessLevel: raw value written for OS X level
+    UInt32 rawForLevel(UInt32 level);
+
+    // IntelBacklightPanel::findIndexForLevel, linear scan of the levels as
+    // configured (-1 below the first entry)
+    UInt32 findIndexForLevel(UInt32 raw);
+
+    // IntelBacklightPanel::levelForIndex
+    UInt32 levelForIndex(UInt32 index);
+
+    // IntelBacklightPanel::levelForValue: approx. OS X level for raw value
+    UInt32 levelForValue(UInt32 raw);
+};
+
+// IntelBacklightPanel::onSmoothTimer before the trajectory buffer: eased
+// position worked out on every tick, setBrightnessLevel for it (level->raw
+// table, write) and the register read back, clamped and published as
+// RawBrightness.  Times are in any unit.
+struct BaselineFade
+{
+    PWMController* m_pwm;
+    OSDictionary* m_properties; // stands in for the panel's property table
+    const UInt32* m_levelToRaw;
+    UInt32 m_easing;
+    UInt32 m_backlightMin, m_backlightMax;
+    int m_smoothFrom, m_from_value, m_value;
+    UInt64 m_smoothStart, m_smoothDuration;
+
+    BaselineFade(PWMController* pwm, const BacklightTables* tables);
+    ~BaselineFade();
+
+    // IntelBacklightPanel::setBrightnessLevelSmooth, from rest
+    void start(int from, int to, UInt64 now, UInt64 duration);
+
+    // false once the target is reached
+    bool tick(UInt64 now);
+};
+
+#endif // _BASELINE_H
@@ -0,0 +1,296 @@
+//
+//  Bench.cpp
+//
+//  Microbenchmarks of the kext's level math, fade timer and configuration
+//  code, with
+//  the tables built from the shipped Info.plist.  Run with "make bench".
+//
+
+#include <stdio.h>
+
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSBoolean.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+
+#include "BacklightMath.h"
+#include "CompiledConfig.h"
+#include "SmoothTransition.h"
+#include "Configuration.h"
+#include "PWMController.h"
+#include "RegisterAccess.h"
+#include "Baseline.h"
+#include "HostSupport.h"
+
+#define kIterations     10000000
+#define kConfigIterations 100000
+#define kRMCFCopies     20000
+#define kFades          200000
+
+// hardware PWM max other than the configured scale, so tables are rescaled
+#define kBenchPWMMax    0x56C
+
+// typical laptop: DSDT plus a dozen or so SSDTs
+#define kBenchACPITables 16
+
+static void appendPair(OSArray* array, const char* key, OSObject* value)
+{
+    OSString* string = OSString::withCString(key);
+    array->setObject(string);
+    array->setObject(value);
+    string->release();
+    value->release();
+}
+
+// RMCF style package for config: key/value pairs, BacklightLevels as an
+// array package (first entry empty array), plus a ">y" boolean
+static OSArray* makeRMCF(const BacklightConfig& config)
+{
+    OSArray* result = OSArray::withCapacity(16);
+    appendPair(result, "PWMMax", OSNumber::withNumber(config.m_pwmMax, 32));
+    appendPair(result, "LEVWInit", OSNumber::withNumber(config.m_levwInit, 32));
+    appendPair(result, "BacklightMin", OSNumber::withNumber(config.m_backlightMin, 32));
+    appendPair(result, "BacklightMax", OSNumber::withNumber(config.m_backlightMax, 32));
+    appendPair(result, "BacklightLevelsScale", OSNumber::withNumber(config.m_backlightLevelsScale, 32));
+    appendPair(result, "SmoothDisable", OSString::withCString(">y"));
+    OSArray* levels = OSArray::withCapacity(config.m_nLevels+1);
+    OSArray* empty = OSArray::withCapacity(0);
+    levels->setObject(empty);
+    empty->release();
+    for (int i = 0; i < config.m_nLevels; i++)
+    {
+        OSNumber* num = OSNumber::withNumber(config.m_backlightLevels[i], 32);
+        levels->setObject(num);
+        num->release();
+    }
+    appendPair(result, "BacklightLevels", levels);
+    return result;
+}
+
+static void benchLevelMath(const char* name, BacklightTables* tables)
+{
+    char label[128];
+    const BacklightConfig& config = tables->m_config;
+    UInt32 count = config.m_nLevels;
+    bool round = !(config.m_options & kLevels16Bit);
+    printf("%s (%u levels, PWM max 0x%x)\n", name, count, tables->m_pwmMax);
+
+    UInt32 rem;
+    snprintf(label, sizeof(label), "  levelIndexForLevel");
+    BENCHMARK(label, kIterations, g_benchSink += levelIndexForLevel(i & kBacklightLevelMax, count, &rem) + rem);
+    snprintf(label, sizeof(label), "  levelForLevelIndex");
+    BENCHMARK(label, kIterations, g_benchSink += levelForLevelIndex(i % count, count));
+
+    // raw values spread over the whole PWM range
+    UInt32 rawMax = tables->m_scaledMax + 1;
+    snprintf(label, sizeof(label), "  findLevelIndex");
+    BENCHMARK(label, kIterations, g_benchSink += findLevelIndex(tables->m_inverseLevels, count, (i * 7919) % rawMax));
+    snprintf(label, sizeof(label), "  levelForRaw");
+    BENCHMARK(label, kIterations, g_benchSink += levelForRaw(tables->m_inverseLevels, count, (i * 7919) % rawMax));
+
+    // setBrightnessLevel: old per call conversion, interpolation per call, dense table
+    BaselinePanel baseline(config, tables->m_pwmMax);
+    snprintf(label, sizeof(label), "  setBrightnessLevel baseline");
+    BENCHMARK(label, kIterations, g_benchSink += baseline.rawForLevel(i & kBacklightLevelMax));
+    snprintf(label, sizeof(label), "  setBrightnessLevel rawForLevel");
+    BENCHMARK(label, kIterations, g_benchSink += rawForLevel(tables->m_scaledLevels, count, i & kBacklightLevelMax, tables->m_scaledMin, tables->m_scaledMax, round));
+    snprintf(label, sizeof(label), "  setBrightnessLevel m_levelToRaw");
+    BENCHMARK(label, kIterations, g_benchSink += tables->m_levelToRaw[i & kBacklightLevelMax]);
+    snprintf(label, sizeof(label), "  smooth step rawForFixedLevel");
+    BENCHMARK(label, kIterations, g_benchSink += rawForFixedLevel(tables->m_levelToRaw, (i * 40503) % (kBacklightLevelMax << 16)));
+
+    // table rescale, as installTables does when PWM max changes
+    snprintf(label, sizeof(label), "  scaleLevel");
+    BENCHMARK(label, kIterations, g_benchSink += scaleLevel(config.m_backlightLevels[i % count], tables->m_pwmMax, config.m_backlightLevelsScale, round));
+    snprintf(label, sizeof(label), "  buildLookupTables");
+    BENCHMARK(label, kConfigIterations, g_benchSink += buildLookupTables(tables, i & 1 ? kBenchPWMMax : config.m_backlightLevelsScale));
+}
+
+static void benchPrecision(const char* name, OSDictionary* dict)
+{
+    // per step cost of a fade with 32-bit tables (interpolated between OS X
+    // levels) against the 16-bit compatibility mode (nearest OS X level)
+    char label[128];
+    printf("%s fade steps, 16-bit vs 32-bit\n", name);
+    for (int mode = 0; mode < 2; mode++)
+    {
+        BacklightTables tables;
+        if (!loadConfiguration(&tables.m_config, dict))
+            return;
+        if (!mode)
+            tables.m_config.m_options |= kLevels16Bit;
+        bool round = !(tables.m_config.m_options & kLevels16Bit);
+        const char* width = round ? "32-bit" : "16-bit";
+        if (!buildLookupTables(&tables, kBenchPWMMax))
+            return;
+
+        const BacklightConfig& config = tables.m_config;
+        UInt32 steps = smoothStepsForDuration(config.m_smoothDuration, config.m_smoothInterval);
+        SmoothTrajectory trajectory;
+        UInt64 start = hostNanoseconds();
+        for (UInt32 i = 0; i < kFades; i++)
+        {
+            // alternating full range fades up and down
+            int from = i & 1 ? kBacklightLevelMax : 0;
+            buildSmoothTrajectory(&trajectory, from << 16, kBacklightLevelMax - from, steps, config.m_smoothEasing, tables.m_levelToRaw, round);
+            g_benchSink += trajectory.m_raw[steps/2];
+        }
+        snprintf(label, sizeof(label), "  %s buildSmoothTrajectory per step", width);
+        reportBenchmark(label, hostNanoseconds() - start, kFades * steps);
+
+        snprintf(label, sizeof(label), "  %s rawForLevel", width);
+        BENCHMARK(label, kIterations, g_benchSink += rawForLevel(tables.m_scaledLevels, config.m_nLevels, i & kBacklightLevelMax, tables.m_scaledMin, tables.m_scaledMax, round));
+        snprintf(label, sizeof(label), "  %s buildLookupTables", width);
+        BENCHMARK(label, kConfigIterations, g_benchSink += buildLookupTables(&tables, i & 1 ? kBenchPWMMax : config.m_backlightLevelsScale));
+    }
+}
+
+static void benchSmoothTick(const char* name, BacklightTables* tables, UInt32 fbtype)
+{
+    // onSmoothTimer before (eased position, setBrightnessLevel, read back for
+    // RawBrightness on every tick) and after (step of the trajectory built
+    // at start, write only if the raw value changed), against simulated
+    // registers; trace and statistics are left out of both
+    const RegisterLayout* layout = findRegisterLayout(fbtype);
+    if (!layout)
+        return;
+    PWMController pwm(new CountingRegisterAccess(new SimulatedRegisterAccess(fbtype, kBenchPWMMax, 0)), layout, 0);
+    pwm.initBacklight(&tables->m_config);
+
+    const BacklightConfig& config = tables->m_config;
+    UInt64 interval = config.m_smoothInterval;
+    UInt64 duration = config.m_smoothDuration;
+    UInt32 steps = smoothStepsForDuration(config.m_smoothDuration, config.m_smoothInterval);
+    bool interpolate = !(config.m_options & kLevels16Bit);
+    char label[128];
+    printf("%s fade timer\n", name);
+
+    BaselineFade baseline(&pwm, tables);
+    UInt64 startTime = 0, tickTime = 0;
+    UInt32 ticks = 0;
+    for (UInt32 i = 0; i < kFades; i++)
+    {
+        // alternating full range fades up and down, one tick per interval
+        int from = i & 1 ? kBacklightLevelMax : 0;
+        UInt64 begin = hostNanoseconds();
+        baseline.start(from, kBacklightLevelMax - from, 0, duration);
+        UInt64 started = hostNanoseconds();
+        UInt64 now = 0;
+        do
+        {
+            now += interval;
+            ++ticks;
+        } while (baseline.tick(now));
+        tickTime += hostNanoseconds() - started;
+        startTime += started - begin;
+    }
+    snprintf(label, sizeof(label), "  onSmoothTimer baseline");
+    reportBenchmark(label, tickTime, ticks);
+    snprintf(label, sizeof(label), "  setBrightnessLevelSmooth baseline");
+    reportBenchmark(label, startTime, kFades);
+
+    SmoothFade fade;
+    smoothFadeReset(&fade, 0, tables->m_levelToRaw[0]);
+    startTime = tickTime = 0;
+    ticks = 0;
+    for (UInt32 i = 0; i < kFades; i++)
+    {
+        int from = i & 1 ? kBacklightLevelMax : 0;
+        UInt64 begin = hostNanoseconds();
+        smoothFadeRetarget(&fade, kBacklightLevelMax - from, 0, duration, steps, config.m_smoothEasing, tables->m_levelToRaw, interpolate);
+        UInt64 started = hostNanoseconds();
+        UInt64 now = 0;
+        do
+        {
+            now += interval;
+            ++ticks;
+            UInt32 raw;
+            if (smoothFadeTick(&fade, now, &raw) && kSmoothNoWrite != raw)
+                pwm.setBacklightLevel(raw);
+        } while (smoothFadeActive(&fade));
+        tickTime += hostNanoseconds() - started;
+        startTime += started - begin;
+    }
+    snprintf(label, sizeof(label), "  onSmoothTimer");
+    reportBenchmark(label, tickTime, ticks);
+    snprintf(label, sizeof(label), "  setBrightnessLevelSmooth");
+    reportBenchmark(label, startTime, kFades);
+}
+
+static void benchConfiguration(const char* name, OSDictionary* dict, BacklightTables* tables)
+{
+    char label[128];
+    printf("%s configuration\n", name);
+
+    // config parsing from the Info.plist dictionary
+    snprintf(label, sizeof(label), "  loadConfiguration");
+    BENCHMARK(label, kConfigIterations,
+        BacklightConfig config;
+        memset(&config, 0, sizeof(config));
+        g_benchSink += loadConfiguration(&config, dict);
+        delete[] config.m_backlightLevels);
+
+    // compiled configuration (NVRAM cache) as the alternative to parsing;
+    // the key is computed on every start, hit or miss
+    OSDictionary* acpi = makeACPITables(kBenchACPITables, 0x1000, 0);
+    UInt32 fingerprint = fingerprintACPITables(acpi, kFNVOffsetBasis);
+    OSData* packed = packCompiledConfig(&tables->m_config, fingerprint);
+    snprintf(label, sizeof(label), "  fingerprintACPITables (%d tables)", kBenchACPITables);
+    BENCHMARK(label, kConfigIterations, g_benchSink += fingerprintACPITables(acpi, kFNVOffsetBasis));
+    acpi->release();
+    if (packed)
+    {
+        snprintf(label, sizeof(label), "  unpackCompiledConfig");
+        BENCHMARK(label, kConfigIterations,
+            BacklightConfig config;
+            memset(&config, 0, sizeof(config));
+            g_benchSink += unpackCompiledConfig(packed, fingerprint, &config);
+            delete[] config.m_backlightLevels);
+        packed->release();
+    }
+
+    // translateArray modifies array packages in place, so each call gets a copy
+    OSArray** copies = new OSArray*[kRMCFCopies];
+    for (int i = 0; i < kRMCFCopies; i++)
+        copies[i] = makeRMCF(tables->m_config);
+    snprintf(label, sizeof(label), "  translateArray (RMCF)");
+    BENCHMARK(label, kRMCFCopies,
+        OSObject* result = translateArray(copies[i]);
+        g_benchSink += (NULL != result);
+        OSSafeRelease(result));
+    for (int i = 0; i < kRMCFCopies; i++)
+        copies[i]->release();
+    delete[] copies;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : kInfoPlistPath;
+    OSDictionary* personalities = loadHandlerPersonalities(path);
+    if (!personalities)
+        return 1;
+
+    for (unsigned i = 0; i < personalities->getCount(); i++)
+    {
+        OSString* name = OSDynamicCast(OSString, personalities->getIteratorObject(i));
+        OSDictionary* personality = OSDynamicCast(OSDictionary, personalities->getObject(name));
+        OSDictionary* dict = OSDynamicCast(OSDictionary, personality->getObject("Configuration"));
+        OSNumber* fbtype = OSDynamicCast(OSNumber, personality->getObject("kFrameBufferType"));
+        BacklightTables* tables = loadHandlerTables(dict, kBenchPWMMax);
+        if (!tables)
+        {
+            fprintf(stderr, "%s: configuration not usable\n", name->getCStringNoCopy());
+            personalities->release();
+            return 1;
+        }
+        benchLevelMath(name->getCStringNoCopy(), tables);
+        benchPrecision(name->getCStringNoCopy(), dict);
+        if (fbtype)
+            benchSmoothTick(name->getCStringNoCopy(), tables, fbtype->unsigned32BitValue());
+        benchConfiguration(name->getCStringNoCopy(), dict, tables);
+        delete tables;
+    }
+    personalities->release();
+    return 0;
+}
@@ -0,0 +1,114 @@
+//
+//  HostSupport.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSUnserialize.h>
+
+#include "HostSupport.h"
+
+volatile UInt32 g_benchSink;
+
+static char* readFile(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* buffer = new char[length+1];
+    if (length < 0 || fread(buffer, 1, length, file) != (size_t)length)
+    {
+        delete[] buffer;
+        buffer = NULL;
+    }
+    else
+        buffer[length] = 0;
+    fclose(file);
+    return buffer;
+}
+
+OSDictionary* loadHandlerPersonalities(const char* path)
+{
+    char* buffer = readFile(path);
+    if (!buffer)
+    {
+        fprintf(stderr, "cannot read %s\n", path);
+        return NULL;
+    }
+    OSString* error = NULL;
+    OSObject* plist = OSUnserializeXML(buffer, &error);
+    delete[] buffer;
+    if (!plist)
+    {
+        fprintf(stderr, "%s: %s\n", path, error ? error->getCStringNoCopy() : "parse error");
+        OSSafeRelease(error);
+        return NULL;
+    }
+
+    OSDictionary* result = NULL;
+    OSDictionary* root = OSDynamicCast(OSDictionary, plist);
+    OSDictionary* personalities = root ? OSDynamicCast(OSDictionary, root->getObject("IOKitPersonalities")) : NULL;
+    if (personalities)
+    {
+        result = OSDictionary::withCapacity(4);
+        for (unsigned i = 0; i < personalities->getCount(); i++)
+        {
+            OSString* name = OSDynamicCast(OSString, personalities->getIteratorObject(i));
+            OSDictionary* personality = OSDynamicCast(OSDictionary, personalities->getObject(name));
+            if (personality && OSDynamicCast(OSDictionary, personality->getObject("Configuration")))
+                result->setObject(name, personality);
+        }
+    }
+    plist->release();
+    return result;
+}
+
+BacklightTables* loadHandlerTables(OSDictionary* config, UInt32 pwmMax)
+{
+    BacklightTables* tables = new BacklightTables;
+    if (!loadConfiguration(&tables->m_config, config) || !buildLookupTables(tables, pwmMax))
+    {
+        delete tables;
+        return NULL;
+    }
+    return tables;
+}
+
+OSDictionary* makeACPITables(unsigned count, unsigned length, UInt32 seed)
+{
+    OSDictionary* tables = OSDictionary::withCapacity(count);
+    UInt8* bytes = new UInt8[length];
+    for (unsigned i = 0; i < count; i++)
+    {
+        char name[16];
+        if (i < 2)
+            snprintf(name, sizeof(name), i ? "SSDT" : "DSDT");
+        else
+            snprintf(name, sizeof(name), "SSDT-%u", i - 1);
+        for (unsigned j = 0; j < length; j++)
+            bytes[j] = (UInt8)((seed + i) * 31 + j);
+        OSData* table = OSData::withBytes(bytes, length);
+        tables->setObject(name, table);
+        table->release();
+    }
+    delete[] bytes;
+    return tables;
+}
+
+UInt64 hostNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void reportBenchmark(const char* name, UInt64 elapsed, UInt32 iterations)
+{
+    printf("%-48s %10.2f ns/op %10u ops\n", name, (double)elapsed / iterations, iterations);
+}
@@ -0,0 +1,45 @@
+//
+//  HostSupport.h
+//
+
+#ifndef _HOST_SUPPORT_H
+#define _HOST_SUPPORT_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSDictionary.h>
+
+#include "Configuration.h"
+
+// Shared by the host tools (bench, test): the shipped Info.plist and timing.
+
+#define kInfoPlistPath "../IntelBacklight/IntelBacklight-Info.plist"
+
+// handler personality name -> personality, for those with a Configuration
+// dictionary (retained, NULL if the file cannot be read or parsed)
+OSDictionary* loadHandlerPersonalities(const char* path);
+
+// loadConfiguration and buildLookupTables for one handler Configuration, as
+// the panel does when there is no RMCF (NULL if not usable)
+BacklightTables* loadHandlerTables(OSDictionary* config, UInt32 pwmMax);
+
+// stand-in for the platform expert's "ACPI Tables": count tables of length
+// bytes, named DSDT, SSDT, SSDT-1..., contents derived from seed (retained)
+OSDictionary* makeACPITables(unsigned count, unsigned length, UInt32 seed);
+
+UInt64 hostNanoseconds();
+
+// one line per benchmark: name, ns/op, iterations
+void reportBenchmark(const char* name, UInt64 elapsed, UInt32 iterations);
+
+// keeps results of benchmarked calls alive
+extern volatile UInt32 g_benchSink;
+
+// times iterations of body (i is the iteration)
+#define BENCHMARK(name, iterations, body) \
+    do { \
+        UInt64 _start = hostNanoseconds(); \
+        for (UInt32 i = 0; i < (iterations); i++) { body; } \
+        reportBenchmark(name, hostNanoseconds() - _start, iterations); \
+    } while (0)
+
+#endif // _HOST_SUPPORT_H
@@ -0,0 +1,82 @@
+//
+//  Simulate.cpp
+//
+//  Smooth transition simulator: every request pattern for distances of 1/16
+//  to full range, up and down, with the transition settings of each handler
+//  in the shipped Info.plist.  Run with "make simulate" (JITTER=us for timer
+//  lateness).  Same seed on every run, so results only change with the
+//  configuration or the fade code.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libkern/c++/OSString.h>
+
+#include "BacklightMath.h"
+#include "SmoothSimulator.h"
+#include "HostSupport.h"
+
+#define kSimDistances   16
+#define kSimSeed        1
+
+// hardware PWM max as left by firmware on most laptops
+#define kSimPWMMax      0x56C
+
+static void simulateHandler(const char* name, const BacklightTables* tables, UInt32 jitter)
+{
+    SmoothSimConfig config;
+    initSmoothSimConfig(&config, tables, jitter, kSimSeed);
+    printf("# %s: SmoothDuration %u SmoothDurationMin %u SmoothInterval %u SmoothEasing %u JitterUS %u\n",
+           name, config.m_duration, config.m_durationMin, config.m_interval, config.m_easing, config.m_jitter);
+    printf("%-8s %5s %5s %8s %6s %6s %14s %9s %10s\n",
+           "pattern", "from", "to", "requests", "ticks", "writes", "timetotarget", "overshoot", "maxrawstep");
+    for (UInt32 pattern = 0; pattern < kSmoothSimPatterns; pattern++)
+    {
+        for (int down = 0; down < 2; down++)
+        {
+            for (int i = 1; i <= kSimDistances; i++)
+            {
+                int from = kBacklightLevelMin;
+                int to = kBacklightLevelMax * i / kSimDistances;
+                if (down)
+                {
+                    from = to;
+                    to = kBacklightLevelMin;
+                }
+                SmoothSimResult result;
+                simulateSmooth(&config, pattern, from, to, &result);
+                printf("%-8s %5d %5d %8u %6u %6u %14u %9u %10u\n",
+                       g_smoothSimPatternNames[pattern], from, to, result.m_requests, result.m_ticks,
+                       result.m_writes, result.m_timeToTarget, result.m_overshoot, result.m_maxRawStep);
+            }
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    UInt32 jitter = argc > 1 ? (UInt32)strtoul(argv[1], NULL, 0) : 0;
+    const char* path = argc > 2 ? argv[2] : kInfoPlistPath;
+    OSDictionary* personalities = loadHandlerPersonalities(path);
+    if (!personalities)
+        return 1;
+
+    for (unsigned i = 0; i < personalities->getCount(); i++)
+    {
+        OSString* name = OSDynamicCast(OSString, personalities->getIteratorObject(i));
+        OSDictionary* personality = OSDynamicCast(OSDictionary, personalities->getObject(name));
+        OSDictionary* dict = OSDynamicCast(OSDictionary, personality->getObject("Configuration"));
+        BacklightTables* tables = loadHandlerTables(dict, kSimPWMMax);
+        if (!tables)
+        {
+            fprintf(stderr, "%s: configuration not usable\n", name->getCStringNoCopy());
+            personalities->release();
+            return 1;
+        }
+        simulateHandler(name->getCStringNoCopy(), tables, jitter);
+        delete tables;
+    }
+    personalities->release();
+    return 0;
+}
@@ -0,0 +1,164 @@
+//
+//  SmoothSimulator.cpp
+//
+
+#include "BacklightMath.h"
+#include "SmoothSimulator.h"
+
+#define kKeyRepeatLevels    (kBacklightLevelMax/16)
+#define kKeyRepeatInterval  80000   // us between repeated key presses
+
+const char* const g_smoothSimPatternNames[kSmoothSimPatterns] = { "single", "repeat", "reversal" };
+
+struct SmoothSimRequest
+{
+    UInt64 m_time;
+    int m_level;
+};
+
+void initSmoothSimConfig(SmoothSimConfig* config, const BacklightTables* tables, UInt32 jitter, UInt32 seed)
+{
+    config->m_duration = tables->m_config.m_smoothDuration;
+    config->m_durationMin = tables->m_config.m_smoothDurationMin;
+    config->m_interval = tables->m_config.m_smoothInterval;
+    config->m_easing = tables->m_config.m_smoothEasing;
+    config->m_levelToRaw = tables->m_levelToRaw;
+    config->m_interpolate = !(tables->m_config.m_options & kLevels16Bit);
+    config->m_jitter = jitter;
+    config->m_seed = seed;
+}
+
+static UInt32 buildRequests(const SmoothSimConfig* config, UInt32 pattern, int from, int to, SmoothSimRequest* requests, UInt32 max)
+{
+    UInt32 count = 0;
+    switch (pattern)
+    {
+        case kSmoothSimRepeat:
+        {
+            int dir = to > from ? 1 : -1;
+            int level = from;
+            UInt64 time = 0;
+            while (level != to && count < max)
+            {
+                level += dir * kKeyRepeatLevels;
+                if ((dir > 0 && level > to) || (dir < 0 && level < to))
+                    level = to;
+                requests[count].m_time = time;
+                requests[count].m_level = level;
+                ++count;
+                time += kKeyRepeatInterval;
+            }
+            break;
+        }
+
+        case kSmoothSimReversal:
+        {
+            UInt32 distance = to > from ? to - from : from - to;
+            UInt32 duration = smoothDurationForDistance(distance, config->m_duration, config->m_durationMin);
+            requests[0].m_time = 0;
+            requests[0].m_level = to;
+            requests[1].m_time = duration * 1000ULL / 2;
+            requests[1].m_level = from;
+            count = 2;
+            break;
+        }
+
+        default:
+            requests[0].m_time = 0;
+            requests[0].m_level = to;
+            count = 1;
+            break;
+    }
+    return count;
+}
+
+// timer fires late by pseudo random amount (LCG), rolled once per arm
+static UInt64 simulateFire(const SmoothSimConfig* config, UInt64 deadline, UInt32* seed)
+{
+    if (!config->m_jitter)
+        return deadline;
+    *seed = *seed * 1664525 + 1013904223;
+    return deadline + (*seed >> 8) % (config->m_jitter + 1);
+}
+
+void simulateSmooth(const SmoothSimConfig* config, UInt32 pattern, int from, int to, SmoothSimResult* result)
+{
+    SmoothSimRequest requests[kBacklightLevelMax/kKeyRepeatLevels+1];
+    UInt32 nRequests = buildRequests(config, pattern, from, to, requests, sizeof(requests)/sizeof(requests[0]));
+
+    SmoothFade fade;
+    smoothFadeReset(&fade, from, config->m_levelToRaw[from]);
+    UInt64 interval = config->m_interval * 1000ULL;
+    UInt64 deadline = 0, fire = 0, settled = 0;
+    UInt32 seed = config->m_seed;
+    bool armed = false;
+    int finalTarget = requests[nRequests-1].m_level;
+    int overshootDir = 0;
+
+    result->m_requests = nRequests;
+    result->m_ticks = 0;
+    result->m_writes = 0;
+    result->m_overshoot = 0;
+    result->m_maxRawStep = 0;
+    result->m_retargets = 0;
+    result->m_finalRaw = fade.m_lastRaw;
+
+    UInt32 next = 0;
+    while (next < nRequests || armed)
+    {
+        if (next < nRequests && (!armed || requests[next].m_time <= fire))
+        {
+            // as setBrightnessLevelSmooth
+            UInt64 now = requests[next].m_time;
+            int level = requests[next].m_level;
+            if (++next == nRequests)
+                overshootDir = finalTarget > fade.m_current ? 1 : finalTarget < fade.m_current ? -1 : 0;
+            if (level == fade.m_target)
+                continue;
+            UInt32 distance = level > fade.m_current ? level - fade.m_current : fade.m_current - level;
+            UInt32 durationMS = smoothDurationForDistance(distance, config->m_duration, config->m_durationMin);
+            if (smoothFadeRetarget(&fade, level, now, durationMS * 1000ULL, smoothStepsForDuration(durationMS, config->m_interval), config->m_easing, config->m_levelToRaw, config->m_interpolate))
+            {
+                deadline = smoothNextDeadline(now, now, interval);
+                fire = simulateFire(config, deadline, &seed);
+                armed = true;
+            }
+            else
+                ++result->m_retargets;
+            continue;
+        }
+
+        // as onSmoothTimer
+        UInt64 now = fire;
+        ++result->m_ticks;
+        UInt32 raw, previous = fade.m_lastRaw;
+        if (smoothFadeTick(&fade, now, &raw))
+        {
+            if (kSmoothNoWrite != raw)
+            {
+                UInt32 change = raw > previous ? raw - previous : previous - raw;
+                if (change > result->m_maxRawStep)
+                    result->m_maxRawStep = change;
+                ++result->m_writes;
+                result->m_finalRaw = raw;
+            }
+            if (next == nRequests && overshootDir)
+            {
+                int past = (fade.m_current - finalTarget) * overshootDir;
+                if (past > (int)result->m_overshoot)
+                    result->m_overshoot = past;
+            }
+        }
+        if (smoothFadeActive(&fade))
+        {
+            deadline = smoothNextDeadline(deadline, now, interval);
+            fire = simulateFire(config, deadline, &seed);
+        }
+        else
+        {
+            armed = false;
+            settled = now;
+        }
+    }
+    result->m_timeToTarget = (UInt32)settled;
+}
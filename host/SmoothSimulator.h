@@ -0,0 +1,58 @@
+//
+//  SmoothSimulator.h
+//
+
+#ifndef _SMOOTH_SIMULATOR_H
+#define _SMOOTH_SIMULATOR_H
+
+#include <libkern/OSTypes.h>
+
+#include "Configuration.h"
+#include "SmoothTransition.h"
+
+// Drives the panel's fade (SmoothFade, see SmoothTransition.h) with a virtual
+// clock in us, so transition settings can be judged without watching the
+// screen.  Used by the simulate tool and the tests.
+
+// request patterns for simulateSmooth
+enum
+{
+    kSmoothSimSingle,   // one request from -> to
+    kSmoothSimRepeat,   // brightness key repeat, 1/16 of full range per request
+    kSmoothSimReversal, // to, then back to from half way through
+    kSmoothSimPatterns
+};
+
+extern const char* const g_smoothSimPatternNames[kSmoothSimPatterns];
+
+struct SmoothSimConfig
+{
+    UInt32 m_duration;      // ms, see BacklightConfig
+    UInt32 m_durationMin;   // ms
+    UInt32 m_interval;      // ms
+    UInt32 m_easing;
+    const UInt32* m_levelToRaw;
+    bool m_interpolate;
+    UInt32 m_jitter;        // timer fires up to this many us late
+    UInt32 m_seed;          // jitter is pseudo random, repeatable for seed
+};
+
+struct SmoothSimResult
+{
+    UInt32 m_requests;
+    UInt32 m_ticks;
+    UInt32 m_writes;        // raw values that differ from previous
+    UInt32 m_timeToTarget;  // us from first request until target is reached
+    UInt32 m_overshoot;     // OS X levels past final target
+    UInt32 m_maxRawStep;    // largest raw change in one tick
+    UInt32 m_finalRaw;      // raw value the panel shows at the end
+    UInt32 m_retargets;     // requests that arrived during a fade
+};
+
+// transition settings and tables as the panel would use them
+void initSmoothSimConfig(SmoothSimConfig* config, const BacklightTables* tables, UInt32 jitter, UInt32 seed);
+
+// runs setBrightnessLevelSmooth/onSmoothTimer steps for pattern
+void simulateSmooth(const SmoothSimConfig* config, UInt32 pattern, int from, int to, SmoothSimResult* result);
+
+#endif // _SMOOTH_SIMULATOR_H
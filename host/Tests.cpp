@@ -0,0 +1,726 @@
+//
+//  Tests.cpp
+//
+//  Host tests of the kext's platform independent code, with configurations
+//  from the shipped Info.plist.  Run with "make test" (exit status is
+//  non-zero if any check failed).
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+
+#include <IOKit/graphics/IODisplay.h>
+
+#include "BacklightMath.h"
+#include "Configuration.h"
+#include "CompiledConfig.h"
+#include "DisplayParams.h"
+#include "PWMController.h"
+#include "RegisterAccess.h"
+#include "SmoothSimulator.h"
+#include "Baseline.h"
+#include "HostSupport.h"
+
+static unsigned g_checks, g_failures;
+
+static void checkEqual(UInt64 actual, UInt64 expected, const char* expr, const char* context, int line)
+{
+    ++g_checks;
+    if (actual == expected)
+        return;
+    ++g_failures;
+    printf("FAIL %s:%d: %s is %llu (0x%llx), expected %llu (0x%llx)\n", context, line, expr, actual, actual, expected, expected);
+}
+
+// context is the configuration (or case) the check runs for
+#define CHECK_EQUAL(context, actual, expected) checkEqual((actual), (expected), #actual, (context), __LINE__)
+#define CHECK(context, expr) checkEqual((expr) ? 1 : 0, 1, #expr, (context), __LINE__)
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark PWMController register traffic
+#pragma mark -
+
+// firmware state the simulated registers start with
+#define kFirmwarePWMMax     0x56C
+#define kFirmwareLevel      0x200
+
+struct TrafficCase
+{
+    UInt32 m_fbtype;
+    UInt32 m_initReads, m_initWrites;       // PWM max as left by firmware
+    UInt32 m_setReads, m_setWrites;
+    UInt32 m_resyncReads, m_resyncWrites;
+    UInt32 m_rescaleReads, m_rescaleWrites; // init with PWMMax different from firmware
+};
+
+static const TrafficCase s_trafficCases[] =
+{
+    // Ivy/Sandy: control registers only checked at init/resync (PCHLInit is -1)
+    { kFBTypeIvySandy,          4, 0,   0, 1,   3, 0,   6, 2 },
+    // Haswell/Broadwell: LEVW at init and on each set (WriteLEVWOnSet), PWM max and duty share LEVX
+    { kFBTypeHaswellBroadwell,  1, 1,   0, 2,   1, 1,   3, 2 },
+    // Cannon Point: LEVW at init only, separate PWM max and duty registers
+    { kFBTypeCannonPoint,       1, 1,   0, 1,   1, 1,   3, 3 },
+};
+
+static const TrafficCase* findTrafficCase(UInt32 fbtype)
+{
+    for (unsigned i = 0; i < sizeof(s_trafficCases)/sizeof(s_trafficCases[0]); i++)
+    {
+        if (s_trafficCases[i].m_fbtype == fbtype)
+            return &s_trafficCases[i];
+    }
+    return NULL;
+}
+
+static void testRegisterTraffic(const char* name, OSDictionary* config, UInt32 fbtype)
+{
+    const TrafficCase* expected = findTrafficCase(fbtype);
+    const RegisterLayout* layout = findRegisterLayout(fbtype);
+    CHECK(name, expected && layout);
+    if (!expected || !layout)
+        return;
+
+    for (int rescale = 0; rescale < 2; rescale++)
+    {
+        BacklightConfig cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        CHECK(name, loadConfiguration(&cfg, config));
+        if (rescale)
+            cfg.m_pwmMax = kFirmwarePWMMax * 2;
+
+        SimulatedRegisterAccess* sim = new SimulatedRegisterAccess(fbtype, kFirmwarePWMMax, kFirmwareLevel);
+        CountingRegisterAccess* regs = new CountingRegisterAccess(sim);
+        PWMController pwm(regs, layout, 0);
+        CHECK_EQUAL(name, pwm.getHardwarePWMMax(), kFirmwarePWMMax);
+
+        // initBacklight: counts as reported, and the same as seen by the backend
+        UInt32 reads = regs->getReads(), writes = regs->getWrites();
+        pwm.initBacklight(&cfg);
+        CHECK_EQUAL(name, pwm.getInitReads(), rescale ? expected->m_rescaleReads : expected->m_initReads);
+        CHECK_EQUAL(name, pwm.getInitWrites(), rescale ? expected->m_rescaleWrites : expected->m_initWrites);
+        CHECK_EQUAL(name, regs->getReads() - reads, pwm.getInitReads());
+        CHECK_EQUAL(name, regs->getWrites() - writes, pwm.getInitWrites());
+        // brightness is kept when PWM max changes
+        UInt32 level = rescale ? scaleLevel(kFirmwareLevel, cfg.m_pwmMax, kFirmwarePWMMax) : kFirmwareLevel;
+        CHECK_EQUAL(name, sim->getDutyCycle(), level);
+        CHECK_EQUAL(name, pwm.getBacklightLevel(), level);
+
+        // setBacklightLevel: same traffic for every level
+        for (level = 0; level <= cfg.m_pwmMax; level += cfg.m_pwmMax / 7)
+        {
+            pwm.setBacklightLevel(level);
+            CHECK_EQUAL(name, pwm.getSetReads(), expected->m_setReads);
+            CHECK_EQUAL(name, pwm.getSetWrites(), expected->m_setWrites);
+            CHECK_EQUAL(name, sim->getDutyCycle(), level);
+        }
+
+        // resyncBacklight with the registers still as programmed
+        pwm.resyncBacklight();
+        CHECK_EQUAL(name, pwm.getResyncReads(), expected->m_resyncReads);
+        CHECK_EQUAL(name, pwm.getResyncWrites(), expected->m_resyncWrites);
+
+        // after firmware disabled PWM (wake), resync enables it again
+        sim->write32(layout->m_flags & kLayoutValidateControl ? LEV2 : LEVW, 0);
+        CHECK_EQUAL(name, sim->getDutyCycle(), 0);
+        pwm.resyncBacklight();
+        pwm.setBacklightLevel(kFirmwareLevel);
+        CHECK_EQUAL(name, sim->getDutyCycle(), kFirmwareLevel);
+
+        delete[] cfg.m_backlightLevels;
+    }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark Level to raw table
+#pragma mark -
+
+// PWM max the tables are built for: as configured (no rescale), typical
+// firmware values, and the largest 16-bit value
+static const UInt32 s_pwmMaxCases[] = { 0, 0x56C, 0x710, 0xAD9, 0x1D4C, 0xFFFF };
+
+static void testLevelToRawBaseline(const char* name, OSDictionary* config)
+{
+    for (unsigned i = 0; i < sizeof(s_pwmMaxCases)/sizeof(s_pwmMaxCases[0]); i++)
+    {
+        BacklightTables tables;
+        CHECK(name, loadConfiguration(&tables.m_config, config));
+        // 16-bit mode is the compatibility mode, must match the old math exactly
+        tables.m_config.m_options |= kLevels16Bit;
+        UInt32 pwmMax = s_pwmMaxCases[i] ? s_pwmMaxCases[i] : tables.m_config.m_backlightLevelsScale;
+        CHECK(name, buildLookupTables(&tables, pwmMax));
+
+        BaselinePanel baseline(tables.m_config, pwmMax);
+        UInt32 mismatches = 0;
+        for (UInt32 level = 0; level <= kBacklightLevelMax; level++)
+        {
+            if (tables.m_levelToRaw[level] != baseline.rawForLevel(level))
+            {
+                if (!mismatches++)
+                    CHECK_EQUAL(name, tables.m_levelToRaw[level], baseline.rawForLevel(level));
+            }
+        }
+        CHECK_EQUAL(name, mismatches, 0);
+        CHECK_EQUAL(name, tables.m_scaledMin, baseline.m_backlightMin);
+        CHECK_EQUAL(name, tables.m_scaledMax, baseline.m_backlightMax);
+    }
+}
+
+static void setConfigNumber(OSDictionary* dict, const char* key, UInt32 value)
+{
+    OSNumber* num = OSNumber::withNumber(value, 32);
+    dict->setObject(key, num);
+    num->release();
+}
+
+// Count, Min, Max, Gamma (16.16)
+struct CurveCase { UInt32 m_count, m_min, m_max, m_gamma; };
+
+static const CurveCase s_curveCases[] =
+{
+    { 65, 0x20, 0x56C, 0x20000 },
+    { 65, 0x20, 0x56C, 0x10000 },
+    { 17, 0, 0xFFFF, 0x23333 },
+    { 3, 0x100, 0x1000, 0x30000 },
+    { 101, 0x10, 0x1D4C, 0x8000 },
+    { kBacklightLevelMax+1, 0, 0xFFFF, 0x28000 },
+    { 33, 0x400, 0x400, 0x20000 },
+};
+
+// BacklightCurve against a floating point reference, and in place of the
+// BacklightLevels of the same configuration
+static void testBacklightCurve(const char* name, OSDictionary* handlerConfig)
+{
+    BacklightConfig original;
+    memset(&original, 0, sizeof(original));
+    CHECK(name, loadConfiguration(&original, handlerConfig));
+
+    for (unsigned i = 0; i < sizeof(s_curveCases)/sizeof(s_curveCases[0]); i++)
+    {
+        const CurveCase& c = s_curveCases[i];
+        OSDictionary* config = OSDictionary::withDictionary(handlerConfig);
+        OSDictionary* curve = OSDictionary::withCapacity(4);
+        setConfigNumber(curve, "Count", c.m_count);
+        setConfigNumber(curve, "Min", c.m_min);
+        setConfigNumber(curve, "Max", c.m_max);
+        setConfigNumber(curve, "Gamma", c.m_gamma);
+        config->setObject("BacklightCurve", curve);
+
+        BacklightConfig cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        CHECK(name, loadConfiguration(&cfg, config));
+        CHECK_EQUAL(name, cfg.m_nLevels, c.m_count);
+        CHECK_EQUAL(name, cfg.m_backlightLevels[0], 0);
+        CHECK_EQUAL(name, cfg.m_backlightLevels[1], c.m_min);
+        CHECK_EQUAL(name, cfg.m_backlightLevels[c.m_count-1], c.m_max);
+
+        // within a unit plus about 0.01% of the range (fixed point log/exp)
+        double gamma = c.m_gamma / 65536.0;
+        double tolerance = 1.0 + (c.m_max - c.m_min) / 8192.0;
+        UInt32 worse = 0, decreases = 0;
+        for (UInt32 j = 1; j < c.m_count; j++)
+        {
+            double expected = c.m_min + (c.m_max - c.m_min) * pow((double)(j-1) / (c.m_count-2), gamma);
+            if (fabs(cfg.m_backlightLevels[j] - expected) > tolerance && !worse++)
+                CHECK_EQUAL(name, cfg.m_backlightLevels[j], (UInt32)(expected + 0.5));
+            if (cfg.m_backlightLevels[j] < cfg.m_backlightLevels[j-1])
+                decreases++;
+        }
+        CHECK_EQUAL(name, worse, 0);
+        CHECK_EQUAL(name, decreases, 0);
+        delete[] cfg.m_backlightLevels;
+        curve->release();
+        config->release();
+    }
+
+    // Min and Max default to BacklightMin and BacklightMax
+    OSDictionary* config = OSDictionary::withDictionary(handlerConfig);
+    OSDictionary* curve = OSDictionary::withCapacity(1);
+    config->setObject("BacklightCurve", curve);
+    BacklightConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    CHECK(name, loadConfiguration(&cfg, config));
+    CHECK_EQUAL(name, cfg.m_nLevels, 65);
+    CHECK_EQUAL(name, cfg.m_backlightLevels[1], original.m_backlightMin);
+    CHECK_EQUAL(name, cfg.m_backlightLevels[64], original.m_backlightMax);
+    delete[] cfg.m_backlightLevels;
+
+    // an unusable curve falls back to BacklightLevels, if there are any
+    setConfigNumber(curve, "Count", 2);
+    memset(&cfg, 0, sizeof(cfg));
+    if (handlerConfig->getObject("BacklightLevels"))
+    {
+        CHECK(name, loadConfiguration(&cfg, config));
+        CHECK_EQUAL(name, cfg.m_nLevels, original.m_nLevels);
+        CHECK(name, cfg.m_backlightLevels && !memcmp(cfg.m_backlightLevels, original.m_backlightLevels, original.m_nLevels * sizeof(UInt32)));
+    }
+    else
+        CHECK(name, !loadConfiguration(&cfg, config));
+    delete[] cfg.m_backlightLevels;
+    curve->release();
+    config->release();
+    delete[] original.m_backlightLevels;
+}
+
+// user supplied tables the running max has to cope with
+static const UInt32 s_dipLevels[] = { 0, 100, 300, 250, 400, 350, 350, 800, 1000, 900, 2000 };
+static const UInt32 s_duplicateLevels[] = { 0, 50, 50, 50, 200, 200, 600, 600, 600, 1500, 1500 };
+
+static void testLevelLookupBaseline(const char* name, const UInt32* levels, UInt32 count)
+{
+    BacklightConfig config;
+    memset(&config, 0, sizeof(config));
+    config.m_nLevels = count;
+    config.m_backlightLevels = const_cast<UInt32*>(levels);
+    config.m_backlightLevelsScale = levels[count-1];
+    config.m_backlightMax = levels[count-1];
+    BaselinePanel baseline(config, config.m_backlightLevelsScale);
+
+    UInt32* monotonic = new UInt32[count];
+    buildMonotonicLevels(monotonic, levels, count);
+    UInt32 indexMismatches = 0, levelMismatches = 0, decreases = 0;
+    UInt32 previous = 0;
+    for (UInt32 raw = levels[0]; raw <= levels[count-1] + 16; raw++)
+    {
+        // binary search over the running max finds what the linear scan did
+        UInt32 index = findLevelIndex(monotonic, count, raw);
+        if (index != baseline.findIndexForLevel(raw) && !indexMismatches++)
+            CHECK_EQUAL(name, index, baseline.findIndexForLevel(raw));
+
+        // same level where the table does not dip between the two entries
+        // (the baseline pro-rates a dip backwards), never decreasing
+        UInt32 level = levelForRaw(monotonic, count, raw);
+        if (index == count-1 || (levels[index] == monotonic[index] && levels[index+1] == monotonic[index+1]))
+        {
+            if (level != baseline.levelForValue(raw) && !levelMismatches++)
+                CHECK_EQUAL(name, level, baseline.levelForValue(raw));
+        }
+        if (level < previous)
+            decreases++;
+        previous = level;
+    }
+    CHECK_EQUAL(name, indexMismatches, 0);
+    CHECK_EQUAL(name, levelMismatches, 0);
+    CHECK_EQUAL(name, decreases, 0);
+    delete[] monotonic;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark Smooth transitions
+#pragma mark -
+
+struct FadeCase
+{
+    UInt32 m_pattern;
+    int m_from, m_to;
+};
+
+// up and down, from rest and retargeted mid-fade (reversal half way through,
+// key repeat every 80 ms while the previous fade is still running)
+static const FadeCase s_fadeCases[] =
+{
+    { kSmoothSimSingle,     0,      1024 },
+    { kSmoothSimSingle,     1024,   0 },
+    { kSmoothSimSingle,     0x300,  0x100 },
+    { kSmoothSimReversal,   0,      0x300 },
+    { kSmoothSimReversal,   0x300,  0x40 },
+    { kSmoothSimRepeat,     0,      1024 },
+    { kSmoothSimRepeat,     1024,   0 },
+};
+
+static const UInt32 s_jitterCases[] = { 0, 2000 };
+
+static void testSmoothSimulation(const char* name, const BacklightTables* tables)
+{
+    for (UInt32 easing = kEasingLinear; easing <= kEasingInOut; easing++)
+    {
+        for (unsigned j = 0; j < sizeof(s_jitterCases)/sizeof(s_jitterCases[0]); j++)
+        {
+            SmoothSimConfig config;
+            initSmoothSimConfig(&config, tables, s_jitterCases[j], 1);
+            config.m_easing = easing;
+            for (unsigned i = 0; i < sizeof(s_fadeCases)/sizeof(s_fadeCases[0]); i++)
+            {
+                const FadeCase& fade = s_fadeCases[i];
+                int target = kSmoothSimReversal == fade.m_pattern ? fade.m_from : fade.m_to;
+                SmoothSimResult result;
+                simulateSmooth(&config, fade.m_pattern, fade.m_from, fade.m_to, &result);
+                // ends exactly on the target, never past it, at most one write per tick
+                CHECK_EQUAL(name, result.m_finalRaw, tables->m_levelToRaw[target]);
+                CHECK_EQUAL(name, result.m_overshoot, 0);
+                CHECK(name, result.m_writes <= result.m_ticks);
+                CHECK_EQUAL(name, result.m_retargets, result.m_requests - 1);
+                if (kSmoothSimSingle == fade.m_pattern)
+                {
+                    UInt32 distance = fade.m_to > fade.m_from ? fade.m_to - fade.m_from : fade.m_from - fade.m_to;
+                    UInt64 duration = smoothDurationForDistance(distance, config.m_duration, config.m_durationMin) * 1000ULL;
+                    CHECK(name, result.m_timeToTarget >= duration);
+                    CHECK(name, result.m_timeToTarget <= duration + config.m_interval * 1000ULL + config.m_jitter);
+                }
+            }
+        }
+    }
+}
+
+static void testSmoothRetarget(const char* name, const BacklightTables* tables)
+{
+    const UInt32* levelToRaw = tables->m_levelToRaw;
+    bool interpolate = !(tables->m_config.m_options & kLevels16Bit);
+    SmoothFade fade;
+    UInt32 raw;
+
+    smoothFadeReset(&fade, 0, levelToRaw[0]);
+    CHECK(name, !smoothFadeActive(&fade));
+    CHECK(name, smoothFadeRetarget(&fade, 0x400, 0, 100, 10, kEasingOut, levelToRaw, interpolate));
+    CHECK(name, smoothFadeActive(&fade));
+    CHECK_EQUAL(name, smoothFadeTick(&fade, 5, &raw), 0);
+    CHECK_EQUAL(name, raw, kSmoothNoWrite);
+    CHECK_EQUAL(name, smoothFadeTick(&fade, 50, &raw), 5);
+    CHECK(name, raw != kSmoothNoWrite);
+    CHECK_EQUAL(name, fade.m_lastRaw, raw);
+
+    // mid-fade, downward: continues from where it is, and keeps what the
+    // panel shows (not levelToRaw of the rounded level)
+    int current = fade.m_current;
+    UInt32 shown = fade.m_lastRaw;
+    CHECK(name, !smoothFadeRetarget(&fade, 0x100, 50, 100, 10, kEasingOut, levelToRaw, interpolate));
+    CHECK_EQUAL(name, fade.m_current, current);
+    CHECK_EQUAL(name, fade.m_lastRaw, shown);
+    CHECK_EQUAL(name, fade.m_trajectory.m_positions[fade.m_trajectory.m_steps-1], 0x100u << 16);
+    CHECK(name, fade.m_trajectory.m_positions[0] <= fade.m_position);
+
+    // last step is exactly the target, then at rest
+    CHECK_EQUAL(name, smoothFadeTick(&fade, 150, &raw), 10);
+    CHECK_EQUAL(name, raw, levelToRaw[0x100]);
+    CHECK_EQUAL(name, fade.m_current, 0x100);
+    CHECK(name, !smoothFadeActive(&fade));
+
+    // cancel stops where it is
+    CHECK(name, smoothFadeRetarget(&fade, 0, 200, 100, 10, kEasingLinear, levelToRaw, interpolate));
+    smoothFadeTick(&fade, 230, &raw);
+    smoothFadeCancel(&fade);
+    CHECK(name, !smoothFadeActive(&fade));
+    CHECK_EQUAL(name, fade.m_target, fade.m_current);
+    CHECK(name, fade.m_current > 0 && fade.m_current < 0x100);
+}
+
+// same-direction retarget just ahead of the fade every tick: the tail starts
+// from the exact position reached, so raw writes never step backwards (and
+// the fade keeps moving)... fine-grained table so interpolation shows
+static void testSmoothRetargetMonotonic()
+{
+    const char* name = "retarget monotonic";
+    static UInt32 levelToRaw[kBacklightLevelMax+1];
+    for (int i = 0; i <= kBacklightLevelMax; i++)
+        levelToRaw[i] = i * 64;
+
+    SmoothFade fade;
+    UInt32 raw;
+    smoothFadeReset(&fade, 0, levelToRaw[0]);
+    smoothFadeRetarget(&fade, kBacklightLevelMax, 0, 100, 10, kEasingLinear, levelToRaw, true);
+    UInt32 last = fade.m_lastRaw;
+    unsigned backwards = 0;
+    for (UInt64 now = 10; smoothFadeActive(&fade) && now < 100000; now += 10)
+    {
+        smoothFadeTick(&fade, now, &raw);
+        if (kSmoothNoWrite != raw)
+        {
+            if (raw < last)
+                backwards++;
+            last = raw;
+        }
+        if (fade.m_current + 2 < kBacklightLevelMax)
+            smoothFadeRetarget(&fade, fade.m_current + 2, now, 100, 10, kEasingLinear, levelToRaw, true);
+    }
+    CHECK_EQUAL(name, backwards, 0);
+    CHECK(name, !smoothFadeActive(&fade));
+    CHECK(name, fade.m_current >= kBacklightLevelMax - 2);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark DisplayParams
+#pragma mark -
+
+static UInt32 getParameter(OSDictionary* params, const OSSymbol* paramName, const OSSymbol* key)
+{
+    OSDictionary* paramDict = OSDynamicCast(OSDictionary, params->getObject(paramName));
+    OSNumber* num = paramDict ? OSDynamicCast(OSNumber, paramDict->getObject(key)) : NULL;
+    return num ? num->unsigned32BitValue() : -1;
+}
+
+static void testDisplayParams()
+{
+    const char* name = "DisplayParams";
+    DisplayParams params;
+    params.init();
+    CHECK(name, !params.publish(NULL, 0x200));
+
+    // setDisplay
+    CHECK(name, params.build(0x200));
+    OSDictionary* dict = params.getParams();
+    CHECK_EQUAL(name, getParameter(dict, gIODisplayBrightnessKey, gIODisplayMinValueKey), kBacklightLevelMin);
+    CHECK_EQUAL(name, getParameter(dict, gIODisplayBrightnessKey, gIODisplayMaxValueKey), kBacklightLevelMax);
+    CHECK_EQUAL(name, getParameter(dict, gIODisplayBrightnessKey, gIODisplayValueKey), 0x200);
+    OSDictionary* commit = OSDynamicCast(OSDictionary, dict->getObject(gIODisplayParametersCommitKey));
+    CHECK(name, commit && commit->getObject("reg"));
+
+    // first doUpdate publishes, merged with parameters of other handlers
+    OSDictionary* other = OSDictionary::withCapacity(2);
+    const OSSymbol* contrast = OSSymbol::withCString("contrast");
+    IODisplay::addParameter(other, contrast, 0, 100);
+    contrast->release();
+    OSDictionary* display = params.publish(other, 0x200);
+    CHECK(name, display && display->getObject("contrast") && display->getObject(gIODisplayBrightnessKey) && display->getObject(gIODisplayParametersCommitKey));
+    CHECK_EQUAL(name, getParameter(display, gIODisplayBrightnessKey, gIODisplayValueKey), 0x200);
+
+    // doUpdate with the display showing the value allocates nothing
+    UInt32 allocations = OSObject::getAllocationCount();
+    for (int i = 0; i < 100; i++)
+        CHECK(name, !params.publish(display, 0x200));
+    CHECK_EQUAL(name, OSObject::getAllocationCount() - allocations, 0);
+
+    // commit (doIntegerSet) changes the display's value, nothing to publish
+    IODisplay::setParameter(display, gIODisplayBrightnessKey, 0x300);
+    CHECK(name, !params.publish(display, 0x300));
+
+    // a changed value is published in new objects, what was published
+    // before is left untouched
+    OSDictionary* published = params.getParams();
+    published->retain();
+    OSObject* brightness = display->getObject(gIODisplayBrightnessKey);
+    OSObject* value = OSDynamicCast(OSDictionary, brightness)->getObject(gIODisplayValueKey);
+    OSDictionary* next = params.publish(display, 0x280);
+    CHECK(name, next && next != display && params.getParams() != published);
+    CHECK(name, next && next->getObject(gIODisplayBrightnessKey) != brightness);
+    CHECK_EQUAL(name, getParameter(next, gIODisplayBrightnessKey, gIODisplayValueKey), 0x280);
+    CHECK(name, published->getObject(gIODisplayBrightnessKey) == brightness);
+    CHECK(name, OSDynamicCast(OSDictionary, brightness)->getObject(gIODisplayValueKey) == value);
+    CHECK_EQUAL(name, getParameter(display, gIODisplayBrightnessKey, gIODisplayValueKey), 0x300);
+    published->release();
+    OSSafeRelease(display);
+    display = next;
+
+    // another handler replaced the display's parameters, ours are published
+    // again even though the value did not change
+    next = params.publish(other, 0x280);
+    CHECK(name, next && next->getObject("contrast") && next->getObject(gIODisplayBrightnessKey));
+    CHECK_EQUAL(name, getParameter(next, gIODisplayBrightnessKey, gIODisplayValueKey), 0x280);
+    OSSafeRelease(next);
+
+    OSDictionary* stats = OSDictionary::withCapacity(3);
+    params.addStats(stats);
+    CHECK_EQUAL(name, OSDynamicCast(OSNumber, stats->getObject("Builds"))->unsigned32BitValue(), 4);
+    CHECK_EQUAL(name, OSDynamicCast(OSNumber, stats->getObject("Publishes"))->unsigned32BitValue(), 3);
+    CHECK_EQUAL(name, OSDynamicCast(OSNumber, stats->getObject("Unchanged"))->unsigned32BitValue(), 101);
+    stats->release();
+
+    // display detached
+    params.release();
+    CHECK(name, !params.getParams());
+    CHECK(name, !params.publish(display, 0x100));
+    OSSafeRelease(display);
+    other->release();
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark Compiled configuration
+#pragma mark -
+
+#define kTestFingerprint 0x12345678
+
+// copy of a packed blob, with header fields changed and length adjusted
+static OSData* alterCompiledConfig(OSData* packed, const CompiledConfigHeader& header, int extra)
+{
+    unsigned length = packed->getLength() + extra;
+    UInt8* bytes = new UInt8[length];
+    memset(bytes, 0, length);
+    memcpy(bytes, packed->getBytesNoCopy(), extra < 0 ? length : packed->getLength());
+    memcpy(bytes, &header, sizeof(header) < length ? sizeof(header) : length);
+    OSData* result = OSData::withBytes(bytes, length);
+    delete[] bytes;
+    return result;
+}
+
+static bool unpackAltered(OSData* packed, const CompiledConfigHeader& header, int extra)
+{
+    OSData* data = alterCompiledConfig(packed, header, extra);
+    BacklightConfig config;
+    memset(&config, 0, sizeof(config));
+    bool result = unpackCompiledConfig(data, kTestFingerprint, &config);
+    delete[] config.m_backlightLevels;
+    data->release();
+    return result;
+}
+
+static void testCompiledConfig(const char* name, const BacklightTables* tables)
+{
+    const BacklightConfig& original = tables->m_config;
+    OSData* packed = packCompiledConfig(&original, kTestFingerprint);
+    if (original.m_nLevels > kCompiledConfigMaxLevels)
+    {
+        CHECK(name, !packed);
+        return;
+    }
+    CHECK(name, packed != NULL);
+    if (!packed)
+        return;
+
+    // round trip
+    BacklightConfig config;
+    memset(&config, 0, sizeof(config));
+    CHECK(name, unpackCompiledConfig(packed, kTestFingerprint, &config));
+    CHECK_EQUAL(name, config.m_pwmMax, original.m_pwmMax);
+    CHECK_EQUAL(name, config.m_pchlInit, original.m_pchlInit);
+    CHECK_EQUAL(name, config.m_levwInit, original.m_levwInit);
+    CHECK_EQUAL(name, config.m_options, original.m_options);
+    CHECK_EQUAL(name, config.m_backlightMin, original.m_backlightMin);
+    CHECK_EQUAL(name, config.m_backlightMax, original.m_backlightMax);
+    CHECK_EQUAL(name, config.m_backlightLevelsScale, original.m_backlightLevelsScale);
+    CHECK_EQUAL(name, config.m_smoothDuration, original.m_smoothDuration);
+    CHECK_EQUAL(name, config.m_smoothDurationMin, original.m_smoothDurationMin);
+    CHECK_EQUAL(name, config.m_smoothInterval, original.m_smoothInterval);
+    CHECK_EQUAL(name, config.m_smoothEasing, original.m_smoothEasing);
+    CHECK_EQUAL(name, config.m_nvramSaveDelay, original.m_nvramSaveDelay);
+    CHECK_EQUAL(name, config.m_wakeFadeDuration, original.m_wakeFadeDuration);
+    CHECK_EQUAL(name, config.m_nLevels, original.m_nLevels);
+    CHECK(name, config.m_backlightLevels && !memcmp(config.m_backlightLevels, original.m_backlightLevels, original.m_nLevels * sizeof(UInt32)));
+    delete[] config.m_backlightLevels;
+
+    // fingerprint mismatch leaves config alone
+    memset(&config, 0, sizeof(config));
+    CHECK(name, !unpackCompiledConfig(packed, kTestFingerprint + 1, &config));
+    CHECK(name, !unpackCompiledConfig(NULL, kTestFingerprint, &config));
+    CHECK(name, !config.m_backlightLevels && !config.m_nLevels);
+
+    // truncated or padded, wrong magic or version, invalid fields
+    CompiledConfigHeader header;
+    memcpy(&header, packed->getBytesNoCopy(), sizeof(header));
+    CHECK(name, unpackAltered(packed, header, 0));
+    CHECK(name, !unpackAltered(packed, header, -1));
+    CHECK(name, !unpackAltered(packed, header, -(int)(original.m_nLevels * sizeof(UInt32))));
+    CHECK(name, !unpackAltered(packed, header, -(int)packed->getLength() + 4));
+    CHECK(name, !unpackAltered(packed, header, 4));
+    CompiledConfigHeader altered = header;
+    altered.m_magic = ~kCompiledConfigMagic;
+    CHECK(name, !unpackAltered(packed, altered, 0));
+    altered = header;
+    altered.m_version = kCompiledConfigVersion - 1;
+    CHECK(name, !unpackAltered(packed, altered, 0));
+    altered = header;
+    altered.m_nLevels = header.m_nLevels + 1;
+    CHECK(name, !unpackAltered(packed, altered, 0));
+    CHECK(name, unpackAltered(packed, altered, sizeof(UInt32)));
+    altered = header;
+    altered.m_smoothInterval = 0;
+    CHECK(name, !unpackAltered(packed, altered, 0));
+    altered = header;
+    altered.m_smoothEasing = kEasingInOut + 1;
+    CHECK(name, !unpackAltered(packed, altered, 0));
+    packed->release();
+}
+
+static void testFingerprintACPITables()
+{
+    const char* name = "ACPI fingerprint";
+    OSDictionary* tables = makeACPITables(8, 0x100, 0);
+    UInt32 fingerprint = fingerprintACPITables(tables, kFNVOffsetBasis);
+    CHECK(name, fingerprint != fingerprintACPITables(NULL, kFNVOffsetBasis));
+
+    // same tables, other insertion order
+    OSDictionary* reordered = OSDictionary::withCapacity(8);
+    for (int i = tables->getCount() - 1; i >= 0; i--)
+    {
+        OSString* key = OSDynamicCast(OSString, tables->getIteratorObject(i));
+        reordered->setObject(key, tables->getObject(key));
+    }
+    CHECK_EQUAL(name, fingerprintACPITables(reordered, kFNVOffsetBasis), fingerprint);
+    reordered->release();
+
+    // any header change (as the checksum does when a body changes) is seen;
+    // bytes past the header are not read
+    OSData* ssdt = OSDynamicCast(OSData, tables->getObject("SSDT-1"));
+    UInt8 bytes[0x100];
+    memcpy(bytes, ssdt->getBytesNoCopy(), sizeof(bytes));
+    bytes[kACPITableHeaderSize] ^= 1;
+    OSData* table = OSData::withBytes(bytes, sizeof(bytes));
+    tables->setObject("SSDT-1", table);
+    table->release();
+    CHECK_EQUAL(name, fingerprintACPITables(tables, kFNVOffsetBasis), fingerprint);
+    bytes[9] ^= 1;
+    table = OSData::withBytes(bytes, sizeof(bytes));
+    tables->setObject("SSDT-1", table);
+    table->release();
+    CHECK(name, fingerprintACPITables(tables, kFNVOffsetBasis) != fingerprint);
+
+    // table added, or too short to have a header
+    tables->release();
+    tables = makeACPITables(9, 0x100, 0);
+    CHECK(name, fingerprintACPITables(tables, kFNVOffsetBasis) != fingerprint);
+    tables->release();
+    tables = makeACPITables(8, 0x100, 0);
+    table = OSData::withBytes(bytes, kACPITableHeaderSize - 1);
+    tables->setObject("SSDT-9", table);
+    table->release();
+    CHECK_EQUAL(name, fingerprintACPITables(tables, kFNVOffsetBasis), fingerprint);
+    tables->release();
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark main
+#pragma mark -
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : kInfoPlistPath;
+    OSDictionary* personalities = loadHandlerPersonalities(path);
+    if (!personalities)
+        return 1;
+
+    for (unsigned i = 0; i < personalities->getCount(); i++)
+    {
+        OSString* key = OSDynamicCast(OSString, personalities->getIteratorObject(i));
+        OSDictionary* personality = OSDynamicCast(OSDictionary, personalities->getObject(key));
+        OSDictionary* config = OSDynamicCast(OSDictionary, personality->getObject("Configuration"));
+        OSNumber* fbtype = OSDynamicCast(OSNumber, personality->getObject("kFrameBufferType"));
+        const char* name = key->getCStringNoCopy();
+        CHECK(name, fbtype != NULL);
+        if (fbtype)
+            testRegisterTraffic(name, config, fbtype->unsigned32BitValue());
+        testLevelToRawBaseline(name, config);
+        testBacklightCurve(name, config);
+        BacklightConfig levels;
+        memset(&levels, 0, sizeof(levels));
+        CHECK(name, loadConfiguration(&levels, config));
+        testLevelLookupBaseline(name, levels.m_backlightLevels, levels.m_nLevels);
+        delete[] levels.m_backlightLevels;
+        if (BacklightTables* tables = loadHandlerTables(config, kFirmwarePWMMax))
+        {
+            testSmoothSimulation(name, tables);
+            testSmoothRetarget(name, tables);
+            testCompiledConfig(name, tables);
+            delete tables;
+        }
+        else
+            CHECK(name, false);
+    }
+    personalities->release();
+    testLevelLookupBaseline("dip levels", s_dipLevels, sizeof(s_dipLevels)/sizeof(s_dipLevels[0]));
+    testLevelLookupBaseline("duplicate levels", s_duplicateLevels, sizeof(s_duplicateLevels)/sizeof(s_duplicateLevels[0]));
+    testSmoothRetargetMonotonic();
+    testFingerprintACPITables();
+    testDisplayParams();
+
+    printf("%u checks, %u failed\n", g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}
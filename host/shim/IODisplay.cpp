@@ -0,0 +1,41 @@
+//
+//  IODisplay.cpp (host shim)
+//
+
+#include <libkern/c++/OSNumber.h>
+#include <IOKit/graphics/IODisplay.h>
+
+const OSSymbol* gIODisplayParametersKey = OSSymbol::withCString("IODisplayParameters");
+const OSSymbol* gIODisplayBrightnessKey = OSSymbol::withCString("brightness");
+const OSSymbol* gIODisplayParametersCommitKey = OSSymbol::withCString("commit");
+const OSSymbol* gIODisplayValueKey = OSSymbol::withCString("value");
+const OSSymbol* gIODisplayMinValueKey = OSSymbol::withCString("min");
+const OSSymbol* gIODisplayMaxValueKey = OSSymbol::withCString("max");
+
+static bool setNumber(OSDictionary* dict, const OSSymbol* key, SInt32 value)
+{
+    OSNumber* num = OSNumber::withNumber(value, 32);
+    if (!num)
+        return false;
+    dict->setObject(key, num);
+    num->release();
+    return true;
+}
+
+bool IODisplay::addParameter(OSDictionary* params, const OSSymbol* paramName, SInt32 min, SInt32 max)
+{
+    OSDictionary* paramDict = OSDictionary::withCapacity(3);
+    if (!paramDict)
+        return false;
+    setNumber(paramDict, gIODisplayMinValueKey, min);
+    setNumber(paramDict, gIODisplayMaxValueKey, max);
+    params->setObject(paramName, paramDict);
+    paramDict->release();
+    return true;
+}
+
+bool IODisplay::setParameter(OSDictionary* params, const OSSymbol* paramName, SInt32 value)
+{
+    OSDictionary* paramDict = OSDynamicCast(OSDictionary, params->getObject(paramName));
+    return paramDict && setNumber(paramDict, gIODisplayValueKey, value);
+}
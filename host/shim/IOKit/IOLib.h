@@ -0,0 +1,23 @@
+//
+//  IOLib.h (host shim)
+//
+
+#ifndef __IOKIT_IOLIB_H
+#define __IOKIT_IOLIB_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <libkern/OSTypes.h>
+
+// kernel log goes to stderr, so it does not mix with tool output
+static inline void IOLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static inline void IOLog(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+#endif // __IOKIT_IOLIB_H
@@ -0,0 +1,27 @@
+//
+//  IODisplay.h (host shim)
+//
+
+#ifndef _IOKIT_IODISPLAY_H
+#define _IOKIT_IODISPLAY_H
+
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSSymbol.h>
+
+// parameter helpers only, as IOGraphics builds them: a dictionary of min,
+// max and value per parameter (setParameter replaces the value object)
+class IODisplay
+{
+public:
+    static bool addParameter(OSDictionary* params, const OSSymbol* paramName, SInt32 min, SInt32 max);
+    static bool setParameter(OSDictionary* params, const OSSymbol* paramName, SInt32 value);
+};
+
+extern const OSSymbol* gIODisplayParametersKey;
+extern const OSSymbol* gIODisplayBrightnessKey;
+extern const OSSymbol* gIODisplayParametersCommitKey;
+extern const OSSymbol* gIODisplayValueKey;
+extern const OSSymbol* gIODisplayMinValueKey;
+extern const OSSymbol* gIODisplayMaxValueKey;
+
+#endif // _IOKIT_IODISPLAY_H
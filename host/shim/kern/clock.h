@@ -0,0 +1,30 @@
+//
+//  clock.h (host shim)
+//
+
+#ifndef _KERN_CLOCK_H
+#define _KERN_CLOCK_H
+
+#include <time.h>
+#include <libkern/OSTypes.h>
+
+// absolute time is nanoseconds on the host
+
+static inline void clock_get_uptime(UInt64* result)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *result = (UInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void absolutetime_to_nanoseconds(UInt64 abstime, UInt64* result)
+{
+    *result = abstime;
+}
+
+static inline void nanoseconds_to_absolutetime(UInt64 nanoseconds, UInt64* result)
+{
+    *result = nanoseconds;
+}
+
+#endif // _KERN_CLOCK_H
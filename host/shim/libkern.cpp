@@ -0,0 +1,799 @@
+//
+//  libkern.cpp (host shim)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSBoolean.h>
+#include <libkern/c++/OSCollectionIterator.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+#include <libkern/c++/OSSymbol.h>
+#include <libkern/c++/OSUnserialize.h>
+
+static UInt32 g_allocations;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSObject
+#pragma mark -
+
+OSObject::OSObject() : m_retainCount(1)
+{
+    ++g_allocations;
+}
+
+OSObject::~OSObject()
+{
+}
+
+void OSObject::retain() const
+{
+    ++m_retainCount;
+}
+
+void OSObject::release() const
+{
+    if (!--m_retainCount)
+        delete this;
+}
+
+int OSObject::getRetainCount() const
+{
+    return m_retainCount;
+}
+
+bool OSObject::isEqualTo(const OSObject* obj) const
+{
+    return this == obj;
+}
+
+UInt32 OSObject::getAllocationCount()
+{
+    return g_allocations;
+}
+
+void OSObject::countAllocation()
+{
+    ++g_allocations;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSString, OSSymbol
+#pragma mark -
+
+OSString::OSString(const char* cString)
+{
+    m_length = (unsigned)strlen(cString);
+    m_string = new char[m_length+1];
+    memcpy(m_string, cString, m_length+1);
+}
+
+OSString::~OSString()
+{
+    delete[] m_string;
+}
+
+OSString* OSString::withCString(const char* cString)
+{
+    return cString ? new OSString(cString) : NULL;
+}
+
+const char* OSString::getCStringNoCopy() const
+{
+    return m_string;
+}
+
+unsigned OSString::getLength() const
+{
+    return m_length;
+}
+
+bool OSString::isEqualTo(const OSObject* obj) const
+{
+    const OSString* string = OSDynamicCast(OSString, obj);
+    return string && isEqualTo(string->m_string);
+}
+
+bool OSString::isEqualTo(const char* cString) const
+{
+    return cString && !strcmp(m_string, cString);
+}
+
+const OSSymbol* OSSymbol::withCString(const char* cString)
+{
+    return cString ? new OSSymbol(cString) : NULL;
+}
+
+const OSSymbol* OSSymbol::withString(const OSString* string)
+{
+    if (const OSSymbol* symbol = OSDynamicCast(OSSymbol, string))
+    {
+        symbol->retain();
+        return symbol;
+    }
+    return string ? withCString(string->getCStringNoCopy()) : NULL;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSNumber
+#pragma mark -
+
+OSNumber::OSNumber(unsigned long long value, unsigned numberOfBits)
+{
+    m_bits = numberOfBits;
+    setValue(value);
+}
+
+OSNumber* OSNumber::withNumber(unsigned long long value, unsigned numberOfBits)
+{
+    if (!numberOfBits || numberOfBits > 64)
+        return NULL;
+    return new OSNumber(value, numberOfBits);
+}
+
+void OSNumber::setValue(unsigned long long value)
+{
+    m_value = m_bits < 64 ? value & ((1ULL << m_bits) - 1) : value;
+}
+
+unsigned OSNumber::numberOfBits() const
+{
+    return m_bits;
+}
+
+UInt8 OSNumber::unsigned8BitValue() const
+{
+    return (UInt8)m_value;
+}
+
+UInt16 OSNumber::unsigned16BitValue() const
+{
+    return (UInt16)m_value;
+}
+
+UInt32 OSNumber::unsigned32BitValue() const
+{
+    return (UInt32)m_value;
+}
+
+UInt64 OSNumber::unsigned64BitValue() const
+{
+    return m_value;
+}
+
+bool OSNumber::isEqualTo(const OSObject* obj) const
+{
+    const OSNumber* number = OSDynamicCast(OSNumber, obj);
+    return number && number->m_value == m_value;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSData
+#pragma mark -
+
+OSData::OSData(unsigned capacity)
+{
+    m_length = 0;
+    m_capacity = capacity;
+    m_bytes = capacity ? new UInt8[capacity] : NULL;
+    if (m_bytes)
+        countAllocation();
+}
+
+OSData::~OSData()
+{
+    delete[] m_bytes;
+}
+
+OSData* OSData::withCapacity(unsigned capacity)
+{
+    return new OSData(capacity);
+}
+
+OSData* OSData::withBytes(const void* bytes, unsigned length)
+{
+    OSData* data = new OSData(length);
+    data->appendBytes(bytes, length);
+    return data;
+}
+
+bool OSData::appendBytes(const void* bytes, unsigned length)
+{
+    if (m_length + length > m_capacity)
+    {
+        unsigned capacity = m_capacity * 2 > m_length + length ? m_capacity * 2 : m_length + length;
+        UInt8* grown = new UInt8[capacity];
+        countAllocation();
+        if (m_length)
+            memcpy(grown, m_bytes, m_length);
+        delete[] m_bytes;
+        m_bytes = grown;
+        m_capacity = capacity;
+    }
+    if (length)
+        memcpy(m_bytes + m_length, bytes, length);
+    m_length += length;
+    return true;
+}
+
+const void* OSData::getBytesNoCopy() const
+{
+    return m_bytes;
+}
+
+unsigned OSData::getLength() const
+{
+    return m_length;
+}
+
+bool OSData::isEqualTo(const OSObject* obj) const
+{
+    const OSData* data = OSDynamicCast(OSData, obj);
+    return data && data->m_length == m_length && (!m_length || !memcmp(data->m_bytes, m_bytes, m_length));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSBoolean
+#pragma mark -
+
+static OSBoolean s_true(true), s_false(false);
+OSBoolean* const kOSBooleanTrue = &s_true;
+OSBoolean* const kOSBooleanFalse = &s_false;
+
+OSBoolean* OSBoolean::withBoolean(bool value)
+{
+    return value ? kOSBooleanTrue : kOSBooleanFalse;
+}
+
+void OSBoolean::retain() const
+{
+}
+
+void OSBoolean::release() const
+{
+}
+
+bool OSBoolean::isTrue() const
+{
+    return m_value;
+}
+
+bool OSBoolean::isFalse() const
+{
+    return !m_value;
+}
+
+bool OSBoolean::getValue() const
+{
+    return m_value;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSCollection, OSArray, OSDictionary
+#pragma mark -
+
+void OSCollection::ensureCapacity(const OSObject**& storage, unsigned count, unsigned& capacity)
+{
+    if (count < capacity)
+        return;
+    unsigned grown = capacity ? capacity * 2 : 4;
+    const OSObject** newStorage = new const OSObject*[grown];
+    countAllocation();
+    for (unsigned i = 0; i < count; i++)
+        newStorage[i] = storage[i];
+    delete[] storage;
+    storage = newStorage;
+    capacity = grown;
+}
+
+OSArray::OSArray(unsigned capacity)
+{
+    m_count = 0;
+    m_capacity = capacity;
+    m_array = capacity ? new const OSObject*[capacity] : NULL;
+    if (m_array)
+        countAllocation();
+}
+
+OSArray::~OSArray()
+{
+    for (unsigned i = 0; i < m_count; i++)
+        m_array[i]->release();
+    delete[] m_array;
+}
+
+OSArray* OSArray::withCapacity(unsigned capacity)
+{
+    return new OSArray(capacity);
+}
+
+unsigned OSArray::getCount() const
+{
+    return m_count;
+}
+
+OSObject* OSArray::getObject(unsigned index) const
+{
+    return index < m_count ? const_cast<OSObject*>(m_array[index]) : NULL;
+}
+
+bool OSArray::setObject(const OSObject* object)
+{
+    if (!object)
+        return false;
+    ensureCapacity(m_array, m_count, m_capacity);
+    object->retain();
+    m_array[m_count++] = object;
+    return true;
+}
+
+bool OSArray::replaceObject(unsigned index, const OSObject* object)
+{
+    if (!object || index >= m_count)
+        return false;
+    object->retain();
+    m_array[index]->release();
+    m_array[index] = object;
+    return true;
+}
+
+void OSArray::removeObject(unsigned index)
+{
+    if (index >= m_count)
+        return;
+    m_array[index]->release();
+    for (unsigned i = index+1; i < m_count; i++)
+        m_array[i-1] = m_array[i];
+    --m_count;
+}
+
+OSObject* OSArray::getIteratorObject(unsigned index) const
+{
+    return getObject(index);
+}
+
+OSDictionary::OSDictionary(unsigned capacity)
+{
+    m_count = 0;
+    m_capacity = capacity;
+    m_keys = m_values = NULL;
+    if (capacity)
+    {
+        m_keys = new const OSObject*[capacity];
+        m_values = new const OSObject*[capacity];
+        countAllocation();
+    }
+}
+
+OSDictionary::~OSDictionary()
+{
+    for (unsigned i = 0; i < m_count; i++)
+    {
+        m_keys[i]->release();
+        m_values[i]->release();
+    }
+    delete[] m_keys;
+    delete[] m_values;
+}
+
+OSDictionary* OSDictionary::withCapacity(unsigned capacity)
+{
+    return new OSDictionary(capacity);
+}
+
+OSDictionary* OSDictionary::withDictionary(const OSDictionary* dict, unsigned capacity)
+{
+    if (!dict)
+        return NULL;
+    OSDictionary* copy = new OSDictionary(capacity > dict->m_count ? capacity : dict->m_count);
+    copy->merge(dict);
+    return copy;
+}
+
+unsigned OSDictionary::getCount() const
+{
+    return m_count;
+}
+
+int OSDictionary::find(const char* key) const
+{
+    for (unsigned i = 0; i < m_count; i++)
+    {
+        if (!strcmp(static_cast<const OSSymbol*>(m_keys[i])->getCStringNoCopy(), key))
+            return i;
+    }
+    return -1;
+}
+
+OSObject* OSDictionary::getObject(const char* key) const
+{
+    int i = key ? find(key) : -1;
+    return i < 0 ? NULL : const_cast<OSObject*>(m_values[i]);
+}
+
+OSObject* OSDictionary::getObject(const OSString* key) const
+{
+    return key ? getObject(key->getCStringNoCopy()) : NULL;
+}
+
+bool OSDictionary::setObject(const OSSymbol* key, const OSObject* object, bool retainKey)
+{
+    int i = find(key->getCStringNoCopy());
+    object->retain();
+    if (i >= 0)
+    {
+        m_values[i]->release();
+        m_values[i] = object;
+        if (!retainKey)
+            key->release();
+        return true;
+    }
+    // both arrays always have the same capacity
+    unsigned capacity = m_capacity;
+    ensureCapacity(m_keys, m_count, capacity);
+    if (capacity != m_capacity)
+    {
+        const OSObject** values = new const OSObject*[capacity];
+        for (unsigned j = 0; j < m_count; j++)
+            values[j] = m_values[j];
+        delete[] m_values;
+        m_values = values;
+        m_capacity = capacity;
+    }
+    if (retainKey)
+        key->retain();
+    m_keys[m_count] = key;
+    m_values[m_count] = object;
+    ++m_count;
+    return true;
+}
+
+bool OSDictionary::setObject(const char* key, const OSObject* object)
+{
+    if (!key || !object)
+        return false;
+    // no symbol needed to replace an existing value
+    int i = find(key);
+    if (i >= 0)
+        return setObject(static_cast<const OSSymbol*>(m_keys[i]), object, true);
+    const OSSymbol* symbol = OSSymbol::withCString(key);
+    return setObject(symbol, object, false);
+}
+
+bool OSDictionary::setObject(const OSString* key, const OSObject* object)
+{
+    if (!key || !object)
+        return false;
+    if (const OSSymbol* symbol = OSDynamicCast(OSSymbol, key))
+        return setObject(symbol, object, true);
+    return setObject(key->getCStringNoCopy(), object);
+}
+
+void OSDictionary::removeObject(const char* key)
+{
+    int i = key ? find(key) : -1;
+    if (i < 0)
+        return;
+    m_keys[i]->release();
+    m_values[i]->release();
+    for (unsigned j = i+1; j < m_count; j++)
+    {
+        m_keys[j-1] = m_keys[j];
+        m_values[j-1] = m_values[j];
+    }
+    --m_count;
+}
+
+bool OSDictionary::merge(const OSDictionary* dict)
+{
+    if (!dict)
+        return false;
+    for (unsigned i = 0; i < dict->m_count; i++)
+        setObject(static_cast<const OSSymbol*>(dict->m_keys[i]), dict->m_values[i], true);
+    return true;
+}
+
+OSObject* OSDictionary::getIteratorObject(unsigned index) const
+{
+    return index < m_count ? const_cast<OSObject*>(m_keys[index]) : NULL;
+}
+
+OSCollectionIterator::OSCollectionIterator(const OSCollection* collection)
+{
+    collection->retain();
+    m_collection = collection;
+    m_index = 0;
+}
+
+OSCollectionIterator::~OSCollectionIterator()
+{
+    m_collection->release();
+}
+
+OSCollectionIterator* OSCollectionIterator::withCollection(const OSCollection* collection)
+{
+    return collection ? new OSCollectionIterator(collection) : NULL;
+}
+
+OSObject* OSCollectionIterator::getNextObject()
+{
+    OSObject* obj = m_collection->getIteratorObject(m_index);
+    if (obj)
+        ++m_index;
+    return obj;
+}
+
+void OSCollectionIterator::reset()
+{
+    m_index = 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma mark -
+#pragma mark OSUnserializeXML
+#pragma mark -
+
+// recursive descent over the tags of a property list; p always points
+// at the next unparsed character
+struct PlistParser
+{
+    const char* p;
+    const char* error;
+};
+
+static void skipMarkup(PlistParser* parser)
+{
+    // whitespace, <?xml ...?>, <!DOCTYPE ...>, <!-- ... -->, <plist ...>, </plist>
+    for (;;)
+    {
+        while (isspace((unsigned char)*parser->p))
+            ++parser->p;
+        const char* end = NULL;
+        if (!strncmp(parser->p, "<!--", 4))
+            end = (end = strstr(parser->p, "-->")) ? end + 3 : NULL;
+        else if (!strncmp(parser->p, "<?", 2) || !strncmp(parser->p, "<!", 2) ||
+                 !strncmp(parser->p, "<plist", 6) || !strncmp(parser->p, "</plist>", 8))
+            end = (end = strchr(parser->p, '>')) ? end + 1 : NULL;
+        if (!end)
+            return;
+        parser->p = end;
+    }
+}
+
+// reads <name> or <name/>, returns false if next tag is something else
+static bool openTag(PlistParser* parser, const char* name, bool* empty)
+{
+    skipMarkup(parser);
+    size_t length = strlen(name);
+    if (parser->p[0] != '<' || strncmp(parser->p+1, name, length))
+        return false;
+    const char* q = parser->p + 1 + length;
+    if (q[0] == '>')
+        *empty = false;
+    else if (q[0] == '/' && q[1] == '>')
+        *empty = true, ++q;
+    else
+        return false;
+    parser->p = q + 1;
+    return true;
+}
+
+static bool closeTag(PlistParser* parser, const char* name)
+{
+    skipMarkup(parser);
+    size_t length = strlen(name);
+    if (strncmp(parser->p, "</", 2) || strncmp(parser->p+2, name, length) || parser->p[2+length] != '>')
+    {
+        parser->error = "mismatched closing tag";
+        return false;
+    }
+    parser->p += 3 + length;
+    return true;
+}
+
+// element text up to closing tag, entities decoded (caller deletes)
+static char* readText(PlistParser* parser, const char* name)
+{
+    const char* end = strchr(parser->p, '<');
+    if (!end)
+    {
+        parser->error = "unterminated element";
+        return NULL;
+    }
+    char* text = new char[end - parser->p + 1];
+    char* out = text;
+    static const struct { const char* entity; char c; } entities[] =
+    {
+        { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' }, { "&quot;", '"' }, { "&apos;", '\'' },
+    };
+    while (parser->p < end)
+    {
+        bool decoded = false;
+        for (unsigned i = 0; i < sizeof(entities)/sizeof(entities[0]) && !decoded; i++)
+        {
+            size_t length = strlen(entities[i].entity);
+            if (!strncmp(parser->p, entities[i].entity, length))
+            {
+                *out++ = entities[i].c;
+                parser->p += length;
+                decoded = true;
+            }
+        }
+        if (!decoded)
+            *out++ = *parser->p++;
+    }
+    *out = 0;
+    if (!closeTag(parser, name))
+    {
+        delete[] text;
+        return NULL;
+    }
+    return text;
+}
+
+static OSData* decodeBase64(const char* text)
+{
+    OSData* data = OSData::withCapacity((unsigned)strlen(text) * 3 / 4 + 1);
+    UInt32 bits = 0;
+    int count = 0;
+    for (const char* c = text; *c && *c != '='; c++)
+    {
+        const char* digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const char* digit = strchr(digits, *c);
+        if (!digit || !*c)
+            continue;
+        bits = (bits << 6) | (UInt32)(digit - digits);
+        if (++count == 4)
+        {
+            UInt8 bytes[3] = { (UInt8)(bits >> 16), (UInt8)(bits >> 8), (UInt8)bits };
+            data->appendBytes(bytes, 3);
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 3)
+    {
+        UInt8 bytes[2] = { (UInt8)(bits >> 10), (UInt8)(bits >> 2) };
+        data->appendBytes(bytes, 2);
+    }
+    else if (count == 2)
+    {
+        UInt8 byte = (UInt8)(bits >> 4);
+        data->appendBytes(&byte, 1);
+    }
+    return data;
+}
+
+static OSObject* parseObject(PlistParser* parser);
+
+static OSObject* parseDictionary(PlistParser* parser, bool empty)
+{
+    OSDictionary* dict = OSDictionary::withCapacity(4);
+    if (empty)
+        return dict;
+    for (;;)
+    {
+        bool emptyKey;
+        if (!openTag(parser, "key", &emptyKey))
+            break;
+        char* key = emptyKey ? NULL : readText(parser, "key");
+        OSObject* value = (emptyKey || key) ? parseObject(parser) : NULL;
+        if (value)
+            dict->setObject(key ? key : "", value);
+        delete[] key;
+        OSSafeRelease(value);
+        if (!value)
+        {
+            dict->release();
+            return NULL;
+        }
+    }
+    if (!closeTag(parser, "dict"))
+    {
+        dict->release();
+        return NULL;
+    }
+    return dict;
+}
+
+static OSObject* parseArray(PlistParser* parser, bool empty)
+{
+    OSArray* array = OSArray::withCapacity(4);
+    if (empty)
+        return array;
+    for (;;)
+    {
+        skipMarkup(parser);
+        if (!strncmp(parser->p, "</", 2))
+            break;
+        OSObject* value = parseObject(parser);
+        if (!value)
+        {
+            array->release();
+            return NULL;
+        }
+        array->setObject(value);
+        value->release();
+    }
+    if (!closeTag(parser, "array"))
+    {
+        array->release();
+        return NULL;
+    }
+    return array;
+}
+
+static OSObject* parseObject(PlistParser* parser)
+{
+    bool empty;
+    if (openTag(parser, "dict", &empty))
+        return parseDictionary(parser, empty);
+    if (openTag(parser, "array", &empty))
+        return parseArray(parser, empty);
+    if (openTag(parser, "true", &empty) && empty)
+        return OSBoolean::withBoolean(true);
+    if (openTag(parser, "false", &empty) && empty)
+        return OSBoolean::withBoolean(false);
+
+    static const char* const textTypes[] = { "string", "integer", "data" };
+    for (unsigned type = 0; type < sizeof(textTypes)/sizeof(textTypes[0]); type++)
+    {
+        if (!openTag(parser, textTypes[type], &empty))
+            continue;
+        char* text = empty ? NULL : readText(parser, textTypes[type]);
+        if (!empty && !text)
+            return NULL;
+        OSObject* result;
+        switch (type)
+        {
+            case 0:
+                result = OSString::withCString(text ? text : "");
+                break;
+            case 1:
+            {
+                // as OSUnserializeXML, 64 bit and 0x prefix allowed
+                char* end;
+                unsigned long long value = strtoull(text ? text : "", &end, 0);
+                if (!text || *end)
+                    parser->error = "bad integer";
+                result = parser->error ? NULL : OSNumber::withNumber(value, 64);
+                break;
+            }
+            default:
+                result = decodeBase64(text ? text : "");
+                break;
+        }
+        delete[] text;
+        return result;
+    }
+    if (!parser->error)
+        parser->error = "unexpected element";
+    return NULL;
+}
+
+OSObject* OSUnserializeXML(const char* buffer, OSString** errorString)
+{
+    PlistParser parser;
+    parser.p = buffer;
+    parser.error = NULL;
+    OSObject* result = parseObject(&parser);
+    if (!result && errorString)
+    {
+        char message[128];
+        snprintf(message, sizeof(message), "%s at offset %ld", parser.error ? parser.error : "parse error", (long)(parser.p - buffer));
+        *errorString = OSString::withCString(message);
+    }
+    return result;
+}
@@ -0,0 +1,31 @@
+//
+//  OSAtomic.h (host shim)
+//
+
+#ifndef _OS_OSATOMIC_H
+#define _OS_OSATOMIC_H
+
+#include <libkern/OSTypes.h>
+
+// return value before the operation, as in the kernel
+static inline SInt32 OSIncrementAtomic(volatile SInt32* address)
+{
+    return __sync_fetch_and_add(address, 1);
+}
+
+static inline SInt32 OSDecrementAtomic(volatile SInt32* address)
+{
+    return __sync_fetch_and_sub(address, 1);
+}
+
+static inline bool OSCompareAndSwap(UInt32 oldValue, UInt32 newValue, volatile UInt32* address)
+{
+    return __sync_bool_compare_and_swap(address, oldValue, newValue);
+}
+
+static inline void OSMemoryBarrier()
+{
+    __sync_synchronize();
+}
+
+#endif // _OS_OSATOMIC_H
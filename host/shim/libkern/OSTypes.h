@@ -0,0 +1,19 @@
+//
+//  OSTypes.h (host shim)
+//
+
+#ifndef _OS_OSTYPES_H
+#define _OS_OSTYPES_H
+
+// same widths as the kernel's, UInt64 is unsigned long long there too
+typedef unsigned char       UInt8;
+typedef unsigned short      UInt16;
+typedef unsigned int        UInt32;
+typedef unsigned long long  UInt64;
+typedef signed char         SInt8;
+typedef signed short        SInt16;
+typedef signed int          SInt32;
+typedef signed long long    SInt64;
+typedef unsigned char       Boolean;
+
+#endif // _OS_OSTYPES_H
@@ -0,0 +1,30 @@
+//
+//  OSArray.h (host shim)
+//
+
+#ifndef _LIBKERN_OSARRAY_H
+#define _LIBKERN_OSARRAY_H
+
+#include <libkern/c++/OSCollection.h>
+
+class OSArray : public OSCollection
+{
+public:
+    static OSArray* withCapacity(unsigned capacity);
+    virtual unsigned getCount() const;
+    OSObject* getObject(unsigned index) const;
+    bool setObject(const OSObject* object);
+    bool replaceObject(unsigned index, const OSObject* object);
+    void removeObject(unsigned index);
+    virtual OSObject* getIteratorObject(unsigned index) const;
+
+protected:
+    OSArray(unsigned capacity);
+    virtual ~OSArray();
+
+private:
+    const OSObject** m_array;
+    unsigned m_count, m_capacity;
+};
+
+#endif // _LIBKERN_OSARRAY_H
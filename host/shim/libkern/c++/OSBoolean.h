@@ -0,0 +1,30 @@
+//
+//  OSBoolean.h (host shim)
+//
+
+#ifndef _LIBKERN_OSBOOLEAN_H
+#define _LIBKERN_OSBOOLEAN_H
+
+#include <libkern/c++/OSObject.h>
+
+// two shared instances, retain/release do nothing
+class OSBoolean : public OSObject
+{
+public:
+    static OSBoolean* withBoolean(bool value);
+    virtual void retain() const;
+    virtual void release() const;
+    bool isTrue() const;
+    bool isFalse() const;
+    bool getValue() const;
+
+    OSBoolean(bool value) : m_value(value) {}
+
+private:
+    bool m_value;
+};
+
+extern OSBoolean* const kOSBooleanTrue;
+extern OSBoolean* const kOSBooleanFalse;
+
+#endif // _LIBKERN_OSBOOLEAN_H
@@ -0,0 +1,23 @@
+//
+//  OSCollection.h (host shim)
+//
+
+#ifndef _LIBKERN_OSCOLLECTION_H
+#define _LIBKERN_OSCOLLECTION_H
+
+#include <libkern/c++/OSObject.h>
+
+class OSCollection : public OSObject
+{
+public:
+    virtual unsigned getCount() const = 0;
+
+    // host only: what OSCollectionIterator returns for index (dictionary key)
+    virtual OSObject* getIteratorObject(unsigned index) const = 0;
+
+protected:
+    // grows storage of count entries to hold one more
+    static void ensureCapacity(const OSObject**& storage, unsigned count, unsigned& capacity);
+};
+
+#endif // _LIBKERN_OSCOLLECTION_H
@@ -0,0 +1,26 @@
+//
+//  OSCollectionIterator.h (host shim)
+//
+
+#ifndef _LIBKERN_OSCOLLECTIONITERATOR_H
+#define _LIBKERN_OSCOLLECTIONITERATOR_H
+
+#include <libkern/c++/OSCollection.h>
+
+class OSCollectionIterator : public OSObject
+{
+public:
+    static OSCollectionIterator* withCollection(const OSCollection* collection);
+    OSObject* getNextObject();
+    void reset();
+
+protected:
+    OSCollectionIterator(const OSCollection* collection);
+    virtual ~OSCollectionIterator();
+
+private:
+    const OSCollection* m_collection;
+    unsigned m_index;
+};
+
+#endif // _LIBKERN_OSCOLLECTIONITERATOR_H
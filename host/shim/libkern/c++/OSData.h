@@ -0,0 +1,29 @@
+//
+//  OSData.h (host shim)
+//
+
+#ifndef _LIBKERN_OSDATA_H
+#define _LIBKERN_OSDATA_H
+
+#include <libkern/c++/OSObject.h>
+
+class OSData : public OSObject
+{
+public:
+    static OSData* withCapacity(unsigned capacity);
+    static OSData* withBytes(const void* bytes, unsigned length);
+    bool appendBytes(const void* bytes, unsigned length);
+    const void* getBytesNoCopy() const;
+    unsigned getLength() const;
+    virtual bool isEqualTo(const OSObject* obj) const;
+
+protected:
+    OSData(unsigned capacity);
+    virtual ~OSData();
+
+private:
+    UInt8* m_bytes;
+    unsigned m_length, m_capacity;
+};
+
+#endif // _LIBKERN_OSDATA_H
@@ -0,0 +1,39 @@
+//
+//  OSDictionary.h (host shim)
+//
+
+#ifndef _LIBKERN_OSDICTIONARY_H
+#define _LIBKERN_OSDICTIONARY_H
+
+#include <libkern/c++/OSCollection.h>
+#include <libkern/c++/OSSymbol.h>
+
+// keys are kept in insertion order, lookup is linear
+class OSDictionary : public OSCollection
+{
+public:
+    static OSDictionary* withCapacity(unsigned capacity);
+    static OSDictionary* withDictionary(const OSDictionary* dict, unsigned capacity = 0);
+    virtual unsigned getCount() const;
+    OSObject* getObject(const char* key) const;
+    OSObject* getObject(const OSString* key) const;
+    bool setObject(const char* key, const OSObject* object);
+    bool setObject(const OSString* key, const OSObject* object);
+    void removeObject(const char* key);
+    bool merge(const OSDictionary* dict);
+    virtual OSObject* getIteratorObject(unsigned index) const;
+
+protected:
+    OSDictionary(unsigned capacity);
+    virtual ~OSDictionary();
+
+private:
+    int find(const char* key) const;
+    bool setObject(const OSSymbol* key, const OSObject* object, bool retainKey);
+
+    const OSObject** m_keys;
+    const OSObject** m_values;
+    unsigned m_count, m_capacity;
+};
+
+#endif // _LIBKERN_OSDICTIONARY_H
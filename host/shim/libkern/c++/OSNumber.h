@@ -0,0 +1,30 @@
+//
+//  OSNumber.h (host shim)
+//
+
+#ifndef _LIBKERN_OSNUMBER_H
+#define _LIBKERN_OSNUMBER_H
+
+#include <libkern/c++/OSObject.h>
+
+class OSNumber : public OSObject
+{
+public:
+    static OSNumber* withNumber(unsigned long long value, unsigned numberOfBits);
+    void setValue(unsigned long long value);
+    unsigned numberOfBits() const;
+    UInt8 unsigned8BitValue() const;
+    UInt16 unsigned16BitValue() const;
+    UInt32 unsigned32BitValue() const;
+    UInt64 unsigned64BitValue() const;
+    virtual bool isEqualTo(const OSObject* obj) const;
+
+protected:
+    OSNumber(unsigned long long value, unsigned numberOfBits);
+
+private:
+    unsigned long long m_value;
+    unsigned m_bits;
+};
+
+#endif // _LIBKERN_OSNUMBER_H
@@ -0,0 +1,41 @@
+//
+//  OSObject.h (host shim)
+//
+
+#ifndef _LIBKERN_OSOBJECT_H
+#define _LIBKERN_OSOBJECT_H
+
+#include <string.h>
+#include <libkern/OSTypes.h>
+
+// Just enough of libkern's reference counted containers to run the kext's
+// configuration, compiled configuration and display parameter code on the
+// host.  Type checks use RTTI instead of OSMetaClass.
+
+class OSObject
+{
+public:
+    OSObject();
+    virtual void retain() const;
+    virtual void release() const;
+    int getRetainCount() const;
+    virtual bool isEqualTo(const OSObject* obj) const;
+
+    // host only: objects created and container storage (re)allocated so far
+    static UInt32 getAllocationCount();
+    static void countAllocation();
+
+protected:
+    virtual ~OSObject();
+
+private:
+    mutable int m_retainCount;
+};
+
+#define OSDynamicCast(type, inst) \
+    (const_cast<type*>(dynamic_cast<const type*>((const OSObject*)(inst))))
+
+#define OSSafeRelease(inst) do { if (inst) (inst)->release(); } while (0)
+#define OSSafeReleaseNULL(inst) do { if (inst) (inst)->release(); (inst) = NULL; } while (0)
+
+#endif // _LIBKERN_OSOBJECT_H
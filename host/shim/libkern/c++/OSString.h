@@ -0,0 +1,28 @@
+//
+//  OSString.h (host shim)
+//
+
+#ifndef _LIBKERN_OSSTRING_H
+#define _LIBKERN_OSSTRING_H
+
+#include <libkern/c++/OSObject.h>
+
+class OSString : public OSObject
+{
+public:
+    static OSString* withCString(const char* cString);
+    const char* getCStringNoCopy() const;
+    unsigned getLength() const;
+    virtual bool isEqualTo(const OSObject* obj) const;
+    bool isEqualTo(const char* cString) const;
+
+protected:
+    OSString(const char* cString);
+    virtual ~OSString();
+
+private:
+    char* m_string;
+    unsigned m_length;
+};
+
+#endif // _LIBKERN_OSSTRING_H
@@ -0,0 +1,21 @@
+//
+//  OSSymbol.h (host shim)
+//
+
+#ifndef _LIBKERN_OSSYMBOL_H
+#define _LIBKERN_OSSYMBOL_H
+
+#include <libkern/c++/OSString.h>
+
+// not unique on the host, symbols compare by value like strings
+class OSSymbol : public OSString
+{
+public:
+    static const OSSymbol* withCString(const char* cString);
+    static const OSSymbol* withString(const OSString* string);
+
+protected:
+    OSSymbol(const char* cString) : OSString(cString) {}
+};
+
+#endif // _LIBKERN_OSSYMBOL_H
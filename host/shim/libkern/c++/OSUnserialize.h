@@ -0,0 +1,14 @@
+//
+//  OSUnserialize.h (host shim)
+//
+
+#ifndef _LIBKERN_OSUNSERIALIZE_H
+#define _LIBKERN_OSUNSERIALIZE_H
+
+#include <libkern/c++/OSString.h>
+
+// property list XML (dict, array, key, string, integer, data, true, false)
+// to containers; the <plist> wrapper of an Info.plist is accepted
+OSObject* OSUnserializeXML(const char* buffer, OSString** errorString = 0);
+
+#endif // _LIBKERN_OSUNSERIALIZE_H
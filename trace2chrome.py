@@ -0,0 +1,185 @@
+#!/usr/bin/env python
+#
+# trace2chrome.py
+#
+# Converts the RM,Trace snapshot of IntelBacklightPanel to Chrome trace JSON,
+# which can be loaded with chrome://tracing or https://ui.perfetto.dev
+#
+# usage:
+#   sudo ioio -s IntelBacklightPanel SnapshotTrace true
+#   ioreg -n IntelBacklightPanel -a >trace.plist
+#   ./trace2chrome.py trace.plist >trace.json
+#
+# Input can be ioreg plist (-a) output, regular ioreg text output, or the raw
+# bytes of the RM,Trace property.
+#
+
+import json
+import plistlib
+import re
+import struct
+import sys
+
+TRACE_MAGIC = 0x52544249
+TRACE_VERSION = 2
+HEADER = struct.Struct('<IIII')
+RECORD = struct.Struct('<QIIIIII')
+
+# must match enum in Trace.h
+EVENTS = {
+    1: 'SetRequest',
+    2: 'Commit',
+    3: 'Transition',
+    4: 'TimerTick',
+    5: 'TransitionDone',
+    6: 'RegisterWrite',
+    7: 'NVRAMWrite',
+    8: 'ACPISave',
+    9: 'Retarget',
+    10: 'TransitionCancel',
+}
+
+REGISTERS = {
+    0x48250: 'LEV2',
+    0x48254: 'LEVL',
+    0x70040: 'P0BL',
+    0xc8250: 'LEVW',
+    0xc8254: 'LEVX',
+    0xc8258: 'LEVD',
+    0xc8350: 'LEVW1',
+    0xc8354: 'LEVX1',
+    0xc8358: 'LEVD1',
+    0xe1180: 'PCHL',
+}
+
+# one row (thread) per kind of activity
+TID_REQUESTS = 1
+TID_FADE = 2
+TID_REGISTERS = 3
+TID_PERSIST = 4
+
+
+def find_trace_in_plist(obj):
+    if isinstance(obj, dict):
+        if 'RM,Trace' in obj:
+            return bytes(obj['RM,Trace'])
+        children = list(obj.values())
+    elif isinstance(obj, list):
+        children = obj
+    else:
+        return None
+    for child in children:
+        found = find_trace_in_plist(child)
+        if found is not None:
+            return found
+    return None
+
+
+def load_trace(data):
+    if data.lstrip().startswith(b'<?xml'):
+        if hasattr(plistlib, 'loads'):
+            plist = plistlib.loads(data)
+        else:
+            plist = plistlib.readPlistFromString(data)
+        return find_trace_in_plist(plist)
+    match = re.search(br'"RM,Trace" = <([0-9a-fA-F]+)>', data)
+    if match:
+        return bytearray.fromhex(match.group(1).decode('ascii'))
+    return data
+
+
+def convert(trace):
+    magic, version, count, lost = HEADER.unpack_from(trace, 0)
+    if magic != TRACE_MAGIC or version != TRACE_VERSION:
+        raise ValueError('not an RM,Trace snapshot (magic %x, version %d)' % (magic, version))
+
+    records = [RECORD.unpack_from(trace, HEADER.size + i * RECORD.size) for i in range(count)]
+    base = records[0][0] if records else 0
+    events = []
+
+    # one process per panel (PanelID + 1, pid 0 is not shown by all viewers)
+    for panel in sorted(set(record[2] for record in records)):
+        pid = panel + 1
+        events += [
+            {'ph': 'M', 'pid': pid, 'name': 'process_name', 'args': {'name': 'IntelBacklight panel %x' % panel}},
+            {'ph': 'M', 'pid': pid, 'tid': TID_REQUESTS, 'name': 'thread_name', 'args': {'name': 'requests'}},
+            {'ph': 'M', 'pid': pid, 'tid': TID_FADE, 'name': 'thread_name', 'args': {'name': 'fade'}},
+            {'ph': 'M', 'pid': pid, 'tid': TID_REGISTERS, 'name': 'thread_name', 'args': {'name': 'registers'}},
+            {'ph': 'M', 'pid': pid, 'tid': TID_PERSIST, 'name': 'thread_name', 'args': {'name': 'NVRAM/ACPI'}},
+        ]
+
+    def add(ph, tid, name, ts, args, **extra):
+        event = {'ph': ph, 'pid': pid, 'tid': tid, 'name': name, 'ts': ts, 'args': args}
+        if ph == 'i':
+            event['s'] = 't'
+        event.update(extra)
+        events.append(event)
+
+    # a transition is one slice from start to done (or cancel); retargets
+    # only mark the slice, and the snapshot may begin or end mid transition
+    in_transition = {}
+    for time, seq, panel, event, arg1, arg2, reserved in records:
+        pid = panel + 1
+        ts = (time - base) / 1000.0
+        name = EVENTS.get(event, 'Event%d' % event)
+        if event == 1:
+            add('i', TID_REQUESTS, name, ts, {'level': arg1})
+        elif event == 2:
+            add('i', TID_REQUESTS, name, ts, {'level': arg1})
+        elif event == 3:
+            if in_transition.get(pid):
+                add('E', TID_FADE, 'transition', ts, {})
+            add('B', TID_FADE, 'transition', ts, {'from': arg1, 'to': arg2})
+            in_transition[pid] = True
+        elif event == 9:
+            add('i', TID_FADE, name, ts, {'from': arg1, 'to': arg2})
+        elif event == 4:
+            if arg2 != 0xFFFFFFFF:
+                add('i', TID_FADE, name, ts, {'step': arg1, 'raw': arg2})
+                add('C', TID_FADE, 'raw', ts, {'raw': arg2})
+            else:
+                add('i', TID_FADE, name, ts, {'step': arg1})
+        elif event == 5 or event == 10:
+            if in_transition.get(pid):
+                add('E', TID_FADE, 'transition', ts, {'level': arg1, 'cancelled': event == 10})
+                in_transition[pid] = False
+            else:
+                add('i', TID_FADE, name, ts, {'level': arg1})
+        elif event == 6:
+            reg = REGISTERS.get(arg1, '0x%x' % arg1)
+            add('i', TID_REGISTERS, 'write ' + reg, ts, {'value': '0x%08x' % arg2})
+        elif event == 7:
+            add('i', TID_PERSIST, name, ts, {'level': arg1})
+        elif event == 8:
+            # recorded after the evaluation completed
+            add('X', TID_PERSIST, name, ts - arg2, {'level': arg1}, dur=arg2)
+        else:
+            add('i', TID_REQUESTS, name, ts, {'arg1': arg1, 'arg2': arg2})
+
+    for pid in in_transition:
+        if in_transition[pid]:
+            add('E', TID_FADE, 'transition', ts, {})
+
+    return {'traceEvents': events, 'otherData': {'lost': lost}}
+
+
+def main():
+    if len(sys.argv) > 2:
+        sys.stderr.write('usage: %s [ioreg-output-or-raw-trace]\n' % sys.argv[0])
+        return 1
+    if len(sys.argv) == 2:
+        with open(sys.argv[1], 'rb') as f:
+            data = f.read()
+    else:
+        data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+    trace = load_trace(data)
+    if not trace:
+        sys.stderr.write('no RM,Trace found in input\n')
+        return 1
+    json.dump(convert(trace), sys.stdout, indent=1)
+    sys.stdout.write('\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())